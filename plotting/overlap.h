@@ -1,5 +1,10 @@
 // A function that takes in two TH1's and returns the computation
-// of their overlap.
+// of their overlap: the sum over bins of sqrt(h1 * h2), which is 1 for two
+// identical unit-area histograms and 0 for disjoint ones. Under- and
+// overflow bins are left out.
+#ifndef OVERLAP_H
+#define OVERLAP_H
+
 #include <algorithm>
 #include <stdio.h>
 #include <math.h>
@@ -11,7 +16,7 @@ Double_t overlap(TH1 *h1, TH1 *h2) {
 
   Double_t overlap = 0.0;
 
-  for (Int_t i = 0; i < length; i++) {
+  for (Int_t i = 1; i <= length; i++) {
     Double_t ith_bin_1 = h1->GetBinContent(i);
     Double_t ith_bin_2 = h2->GetBinContent(i);
     Double_t product_i = sqrt(ith_bin_1 * ith_bin_2);
@@ -20,3 +25,5 @@ Double_t overlap(TH1 *h1, TH1 *h2) {
 
   return overlap;
 }
+
+#endif
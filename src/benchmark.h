@@ -0,0 +1,129 @@
+// Timing and result tables for the benchmark macros (BenchmarkKernels.C,
+// BenchmarkSkim.C).
+//
+// TimeKernel() runs a kernel over the same events `repeats` times and keeps
+// the fastest pass, which is the least noisy figure on a shared machine.
+// TimeOnce() is for whole loops that are too slow to repeat.
+//
+// Results are appended to a tab-separated table, one row per benchmark:
+//
+//   version  date  host  suite  benchmark  parameter  events  repeats
+//   seconds  events_per_second  ns_per_event  bytes_per_event
+//
+// `version` is `git describe --always --dirty` of the working tree, so rows
+// from different commits can be compared with any TSV tool. The header is
+// only written when the table is new; the column order must not change.
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <TSystem.h>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+
+// Kernels add their results here so the compiler cannot drop them.
+volatile Double_t benchmark_sink = 0;
+
+
+struct BenchmarkResult {
+  std::string suite;
+  std::string name;
+  std::string parameter;
+  Long64_t events = 0;
+  int repeats = 1;
+  Double_t seconds = 0;          // Fastest pass.
+  Double_t bytes_per_event = 0;  // 0 if not measured.
+
+  Double_t EventsPerSecond() const { return seconds > 0 ? events / seconds : 0.; }
+  Double_t NsPerEvent() const { return events > 0 ? 1e9 * seconds / events : 0.; }
+};
+
+
+void PrintBenchmarkResult(const BenchmarkResult &r) {
+  printf("%-8s %-28s %-14s %12.0f events/s %10.1f ns/event", r.suite.c_str(),
+         r.name.c_str(), r.parameter.c_str(), r.EventsPerSecond(), r.NsPerEvent());
+  if (r.bytes_per_event > 0) printf(" %10.1f bytes/event", r.bytes_per_event);
+  printf(" \n");
+}
+
+
+// Times `run`, which processes `events` events per call, as the best of
+// `repeats` calls after one warm-up call.
+template <class Kernel>
+BenchmarkResult TimeKernel(const std::string &suite, const std::string &name,
+                           const std::string &parameter, Long64_t events, Kernel run,
+                           int repeats = 5) {
+  typedef std::chrono::steady_clock Clock;
+  BenchmarkResult r;
+  r.suite = suite;
+  r.name = name;
+  r.parameter = parameter;
+  r.events = events;
+  r.repeats = repeats;
+  run();
+  for (int k = 0; k < repeats; ++k) {
+    Clock::time_point start = Clock::now();
+    run();
+    Double_t seconds = std::chrono::duration<Double_t>(Clock::now() - start).count();
+    if (k == 0 || seconds < r.seconds) r.seconds = seconds;
+  }
+  PrintBenchmarkResult(r);
+  return r;
+}
+
+
+// Times a single call of `run`, with no warm-up.
+template <class Loop>
+BenchmarkResult TimeOnce(const std::string &suite, const std::string &name,
+                         const std::string &parameter, Long64_t events, Loop run) {
+  typedef std::chrono::steady_clock Clock;
+  BenchmarkResult r;
+  r.suite = suite;
+  r.name = name;
+  r.parameter = parameter;
+  r.events = events;
+  Clock::time_point start = Clock::now();
+  run();
+  r.seconds = std::chrono::duration<Double_t>(Clock::now() - start).count();
+  PrintBenchmarkResult(r);
+  return r;
+}
+
+
+// Appends `results` to the table at `path`, writing the header first if
+// the table does not exist yet.
+bool WriteBenchmarkResults(const std::vector<BenchmarkResult> &results, const char *path) {
+  bool is_new = gSystem->AccessPathName(path);  // True if missing.
+  FILE *out = fopen(path, "a");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  if (is_new) {
+    fprintf(out, "version\tdate\thost\tsuite\tbenchmark\tparameter\tevents\trepeats\t"
+                 "seconds\tevents_per_second\tns_per_event\tbytes_per_event\n");
+  }
+
+  std::string version = gSystem->GetFromPipe("git describe --always --dirty 2>/dev/null").Data();
+  if (version.empty()) version = "unknown";
+  char date[32];
+  time_t now = time(0);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+  for (const BenchmarkResult &r : results) {
+    fprintf(out, "%s\t%s\t%s\t%s\t%s\t%s\t%lld\t%d\t%.6g\t%.6g\t%.6g\t%.6g\n",
+            version.c_str(), date, gSystem->HostName(), r.suite.c_str(), r.name.c_str(),
+            r.parameter.c_str(), r.events, r.repeats, r.seconds, r.EventsPerSecond(),
+            r.NsPerEvent(), r.bytes_per_event);
+  }
+  fclose(out);
+  printf("Wrote %zu results to %s \n", results.size(), path);
+  return true;
+}
+
+#endif
@@ -0,0 +1,260 @@
+// Columnar access to the flat skim ntuples written by Cutflow.C.
+//
+// FlatTreeBlockReader loads blocks of events branch by branch into
+// structure-of-arrays columns, and the kernels below compute kinematic
+// quantities over a whole block in plain loops over contiguous arrays.
+// Each kernel repeats the arithmetic of the TLorentzVector/TVector3 code it
+// replaces, in the same order, so columnar results are bit-identical to the
+// row-wise ones; TestColumnarKinematics.C checks this.
+
+#ifndef COLUMNAR_KINEMATICS_H
+#define COLUMNAR_KINEMATICS_H
+
+#include <TTree.h>
+#include <TBranch.h>
+#include <TMath.h>
+#include <TVector2.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+const int kColumnBlockSize = 4096;
+const Long64_t kFlatTreeCacheSize = 64 * 1024 * 1024;
+
+
+// One value per event of a block.
+typedef Double_t Column[kColumnBlockSize];
+
+
+// Four-momentum components of one physics object over a block of events.
+// pt, eta and phi are recomputed from (px, py, pz) exactly as
+// TLorentzVector::Pt(), Eta() and Phi() do.
+struct ObjectColumns {
+  Column px, py, pz, e;
+  Column pt, eta, phi;
+};
+
+
+// Signed square root, as TLorentzVector::M() and Mt() return it.
+inline Double_t SignedSqrt(Double_t mm) {
+  return mm < 0.0 ? -TMath::Sqrt(-mm) : TMath::Sqrt(mm);
+}
+
+
+// Invariant mass of (a + b) for event i.
+inline Double_t PairMass(const ObjectColumns &a, const ObjectColumns &b, int i) {
+  Double_t px = a.px[i] + b.px[i];
+  Double_t py = a.py[i] + b.py[i];
+  Double_t pz = a.pz[i] + b.pz[i];
+  Double_t e = a.e[i] + b.e[i];
+  return SignedSqrt(e*e - (px*px + py*py + pz*pz));
+}
+
+
+// TVector3::Perp(), Phi() and PseudoRapidity() over a block.
+void UpdatePtEtaPhi(ObjectColumns &obj, int n) {
+  for (int i = 0; i < n; ++i) {
+    Double_t x = obj.px[i], y = obj.py[i], z = obj.pz[i];
+    obj.pt[i] = TMath::Sqrt(x*x + y*y);
+    obj.phi[i] = (x == 0.0 && y == 0.0) ? 0.0 : TMath::ATan2(y, x);
+
+    Double_t ptot = TMath::Sqrt(x*x + y*y + z*z);
+    Double_t cos_theta = ptot == 0.0 ? 1.0 : z/ptot;
+    if (cos_theta*cos_theta < 1) {
+      obj.eta[i] = -0.5*TMath::Log((1.0 - cos_theta)/(1.0 + cos_theta));
+    } else if (z == 0) {
+      obj.eta[i] = 0;
+    } else {
+      obj.eta[i] = z > 0 ? 10e10 : -10e10;
+    }
+  }
+}
+
+
+// TLorentzVector::SetPtEtaPhiE over a block of stored (pt, eta, phi, E).
+void SetPtEtaPhiE(ObjectColumns &obj, const Float_t *pt, const Float_t *eta,
+                  const Float_t *phi, const Float_t *e, int n) {
+  for (int i = 0; i < n; ++i) {
+    Double_t p = TMath::Abs((Double_t) pt[i]);
+    obj.px[i] = p*TMath::Cos(phi[i]);
+    obj.py[i] = p*TMath::Sin(phi[i]);
+    obj.pz[i] = p*sinh((Double_t) eta[i]);
+    obj.e[i] = e[i];
+  }
+  UpdatePtEtaPhi(obj, n);
+}
+
+
+// out = a + b, component-wise (pt/eta/phi of out are not updated).
+void SumColumns(const ObjectColumns &a, const ObjectColumns &b, int n,
+                ObjectColumns &out) {
+  for (int i = 0; i < n; ++i) {
+    out.px[i] = a.px[i] + b.px[i];
+    out.py[i] = a.py[i] + b.py[i];
+    out.pz[i] = a.pz[i] + b.pz[i];
+    out.e[i] = a.e[i] + b.e[i];
+  }
+}
+
+
+// TLorentzVector::M().
+void MassColumn(const ObjectColumns &p, int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = SignedSqrt(p.e[i]*p.e[i] - (p.px[i]*p.px[i] + p.py[i]*p.py[i] + p.pz[i]*p.pz[i]));
+  }
+}
+
+
+// TLorentzVector::Pt(), for vectors whose pt column is not up to date.
+void PtColumn(const ObjectColumns &p, int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = TMath::Sqrt(p.px[i]*p.px[i] + p.py[i]*p.py[i]);
+  }
+}
+
+
+// TLorentzVector::Mt().
+void MtColumn(const ObjectColumns &p, int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = SignedSqrt(p.e[i]*p.e[i] - p.pz[i]*p.pz[i]);
+  }
+}
+
+
+// a.DeltaPhi(b).
+void DeltaPhiColumn(const ObjectColumns &a, const ObjectColumns &b, int n,
+                    Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    out[i] = TVector2::Phi_mpi_pi(a.phi[i] - b.phi[i]);
+  }
+}
+
+
+// a.DeltaR(b).
+void DeltaRColumn(const ObjectColumns &a, const ObjectColumns &b, int n,
+                  Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    Double_t deta = a.eta[i] - b.eta[i];
+    Double_t dphi = TVector2::Phi_mpi_pi(a.phi[i] - b.phi[i]);
+    out[i] = TMath::Sqrt(deta*deta + dphi*dphi);
+  }
+}
+
+
+void CosColumn(const Double_t *in, int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) out[i] = cos(in[i]);
+}
+
+
+// Transverse mass of k against the missing momentum, as Mt() in Analyzer.C.
+void TransverseMassColumn(const ObjectColumns &pt_miss, const ObjectColumns &k,
+                          int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    Double_t dphi = TVector2::Phi_mpi_pi(k.phi[i] - pt_miss.phi[i]);
+    out[i] = TMath::Sqrt(2 * (k.pt[i]) * (pt_miss.pt[i]) * (1 - TMath::Cos(dphi)));
+  }
+}
+
+
+// p_zeta^miss - 0.85 * p_zeta^vis, as GetDZeta() in Analyzer.C.
+void DZetaColumn(const ObjectColumns &vis1, const ObjectColumns &vis2,
+                 const ObjectColumns &pt_miss, int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    Double_t x1 = vis1.px[i], y1 = vis1.py[i];
+    Double_t x2 = vis2.px[i], y2 = vis2.py[i];
+    Double_t mag1 = TMath::Sqrt(x1*x1 + y1*y1);
+    Double_t mag2 = TMath::Sqrt(x2*x2 + y2*y2);
+
+    Double_t zeta_x = mag2*x1 + mag1*x2;
+    Double_t zeta_y = mag2*y1 + mag1*y2;
+    Double_t inv_zeta_mag = 1/TMath::Sqrt(zeta_x*zeta_x + zeta_y*zeta_y);
+
+    Double_t pt_vis_zeta = ((x1 + x2)*zeta_x + (y1 + y2)*zeta_y) * inv_zeta_mag;
+    Double_t pt_miss_zeta = (pt_miss.px[i]*zeta_x + pt_miss.py[i]*zeta_y) * inv_zeta_mag;
+    out[i] = pt_miss_zeta - 0.85 * pt_vis_zeta;
+  }
+}
+
+
+// Larger pair mass of the (tau, ell) x (jet1, jet2) pairing with the
+// smaller mass difference, as MassHypothesis() in Analyzer.C.
+void MassHypothesisColumn(const ObjectColumns &tau, const ObjectColumns &ell,
+                          const ObjectColumns &jet1, const ObjectColumns &jet2,
+                          int n, Double_t *out) {
+  for (int i = 0; i < n; ++i) {
+    Double_t m11 = PairMass(tau, jet1, i);
+    Double_t m22 = PairMass(ell, jet2, i);
+    Double_t m12 = PairMass(tau, jet2, i);
+    Double_t m21 = PairMass(ell, jet1, i);
+    out[i] = ((m11 - m22) < (m12 - m21)) ? std::max(m11, m22) : std::max(m12, m21);
+  }
+}
+
+
+// Reads the Float_t[4] object branches and the weight of a skim tree in
+// blocks of events. Each branch is read for the whole block before moving
+// on to the next, so baskets are decompressed once and in order, and a
+// TTreeCache prefetches them in large reads.
+class FlatTreeBlockReader {
+ public:
+  FlatTreeBlockReader(TTree *tree) : tree(tree) {
+    tree->SetCacheSize(kFlatTreeCacheSize);
+    tree->AddBranchToCache("*", kTRUE);
+    b_tau = tree->GetBranch("TauBranch");
+    b_lep1 = tree->GetBranch("Lep1Branch");
+    b_lep2 = tree->GetBranch("Lep2Branch");
+    b_btag = tree->GetBranch("BTagBranch");
+    b_jet = tree->GetBranch("JetBranch");
+    b_met = tree->GetBranch("METBranch");
+    b_wgt = tree->GetBranch("Weight");
+  }
+
+  Long64_t GetEntries() const { return tree->GetEntries(); }
+
+  // Loads entries [first, first + kColumnBlockSize) or up to `last` (the
+  // end of the tree by default), and returns the number of events loaded.
+  int ReadBlock(Long64_t first, Long64_t last = -1) {
+    if (last < 0) last = GetEntries();
+    int n = (int) std::min<Long64_t>(kColumnBlockSize, last - first);
+    if (n <= 0) return 0;
+    ReadObject(b_tau, first, n, tau);
+    ReadObject(b_lep1, first, n, lep1);
+    ReadObject(b_lep2, first, n, lep2);
+    ReadObject(b_btag, first, n, btag);
+    ReadObject(b_jet, first, n, jet);
+    ReadObject(b_met, first, n, met);
+
+    b_wgt->SetAddress(&wgt);
+    for (int i = 0; i < n; ++i) {
+      b_wgt->GetEntry(first + i);
+      weight[i] = wgt;
+    }
+    return n;
+  }
+
+  ObjectColumns tau, lep1, lep2, btag, jet, met;
+  Float_t weight[kColumnBlockSize];
+
+ private:
+  void ReadObject(TBranch *branch, Long64_t first, int n, ObjectColumns &obj) {
+    branch->SetAddress(&arr);
+    for (int i = 0; i < n; ++i) {
+      branch->GetEntry(first + i);
+      raw_pt[i] = arr[0];
+      raw_eta[i] = arr[1];
+      raw_phi[i] = arr[2];
+      raw_e[i] = arr[3];
+    }
+    SetPtEtaPhiE(obj, raw_pt, raw_eta, raw_phi, raw_e, n);
+  }
+
+  TTree *tree;
+  TBranch *b_tau, *b_lep1, *b_lep2, *b_btag, *b_jet, *b_met, *b_wgt;
+  Float_t arr[4];
+  Float_t wgt;
+  Float_t raw_pt[kColumnBlockSize], raw_eta[kColumnBlockSize];
+  Float_t raw_phi[kColumnBlockSize], raw_e[kColumnBlockSize];
+};
+
+#endif
@@ -0,0 +1,353 @@
+// Threshold scans over per-event cut variables.
+//
+// A scan takes a few cuts, each a variable with a list of candidate
+// thresholds, and the per-event values of those variables for a signal and
+// a background sample. One pass over the events builds a pass bitmask for
+// every (cut, threshold): one bit per event, 64 events per word. Every
+// point of the threshold grid is then evaluated from the masks alone:
+//
+//   - the yield passing all cuts, and the expected significance;
+//   - N-1 yields (all cuts but one), giving the efficiency of each cut
+//     after all the others;
+//   - pairwise yields for every two cuts, the same table as the
+//     efficiency matrix of cutflow_MT2.C.
+//
+// Counts are weighted; the weights carry the cross-section and luminosity,
+// so significances are in expected events.
+
+#ifndef CUT_SCAN_H
+#define CUT_SCAN_H
+
+#include <Rtypes.h>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+enum CutDirection {
+  kPassAbove,  // Pass if value > threshold.
+  kPassBelow   // Pass if value < threshold.
+};
+
+
+struct ScanCut {
+  std::string name;
+  CutDirection direction;
+  std::vector<Float_t> thresholds;
+
+  bool Pass(Float_t value, int t) const {
+    return direction == kPassAbove ? value > thresholds[t] : value < thresholds[t];
+  }
+};
+
+
+// Per-event cut variables of one sample: values[c][i] is the variable of
+// cut c in event i. NaN fails every threshold.
+struct ScanSample {
+  std::vector<std::vector<Float_t> > values;
+  std::vector<Float_t> weight;
+
+  explicit ScanSample(int n_cuts = 0) : values(n_cuts) {}
+
+  void Add(const Float_t *x, Float_t w) {
+    for (size_t c = 0; c < values.size(); ++c) values[c].push_back(x[c]);
+    weight.push_back(w);
+  }
+  Long64_t size() const { return weight.size(); }
+};
+
+
+// Bit i%64 of word i/64 is set if event i passes.
+typedef std::vector<ULong64_t> EventMask;
+
+
+// Sum of w[k] over the set bits k of `bits`.
+inline Double_t MaskedSum(ULong64_t bits, const Float_t *w) {
+  Double_t sum = 0;
+  while (bits) {
+    sum += w[__builtin_ctzll(bits)];
+    bits &= bits - 1;
+  }
+  return sum;
+}
+
+
+// masks[c][t]: the events of `sample` passing cut c at threshold t.
+std::vector<std::vector<EventMask> > BuildPassMasks(const ScanSample &sample,
+                                                    const std::vector<ScanCut> &cuts) {
+  Long64_t n = sample.size();
+  Long64_t n_words = (n + 63) / 64;
+  std::vector<std::vector<EventMask> > masks(cuts.size());
+  for (size_t c = 0; c < cuts.size(); ++c) {
+    const ScanCut &cut = cuts[c];
+    const Float_t *x = sample.values[c].data();
+    masks[c].assign(cut.thresholds.size(), EventMask(n_words, 0));
+    for (size_t t = 0; t < cut.thresholds.size(); ++t) {
+      ULong64_t *m = masks[c][t].data();
+      for (Long64_t i = 0; i < n; ++i) {
+        if (cut.Pass(x[i], t)) m[i >> 6] |= 1ULL << (i & 63);
+      }
+    }
+  }
+  return masks;
+}
+
+
+// Median expected significance of s signal events over b background events
+// (Asimov): sqrt(2((s + b) ln(1 + s/b) - s)).
+inline Double_t AsimovSignificance(Double_t s, Double_t b) {
+  if (s <= 0 || b <= 0) return 0;
+  return std::sqrt(2*((s + b)*std::log(1 + s/b) - s));
+}
+
+
+// One point of the threshold grid.
+struct ScanPoint {
+  std::vector<int> index;              // Threshold index of each cut.
+  Double_t s = 0, b = 0;               // Passing every cut.
+  std::vector<Double_t> s_nm1, b_nm1;  // Passing every cut but c.
+  Double_t significance = 0;
+};
+
+
+struct CutScanResult {
+  std::vector<ScanCut> cuts;
+  Double_t s_total = 0, b_total = 0;
+  // Passing cut c at threshold t: [c][t].
+  std::vector<std::vector<Double_t> > s_single, b_single;
+  // Passing cut i at ti and cut j at tj, i < j: [i*n + j][ti*n_j + tj].
+  std::vector<std::vector<Double_t> > s_pair, b_pair;
+  std::vector<ScanPoint> points;
+
+  // Yield passing cuts i and j at the thresholds of `p` (i == j: cut i alone).
+  Double_t PairYield(bool signal, const ScanPoint &p, int i, int j) const {
+    if (i == j) return (signal ? s_single : b_single)[i][p.index[i]];
+    if (i > j) std::swap(i, j);
+    int n_j = cuts[j].thresholds.size();
+    return (signal ? s_pair : b_pair)[i*cuts.size() + j][p.index[i]*n_j + p.index[j]];
+  }
+
+  // Index of the point with the largest significance; -1 if there is none.
+  int Best() const {
+    int best = -1;
+    for (size_t k = 0; k < points.size(); ++k) {
+      if (best < 0 || points[k].significance > points[best].significance) best = k;
+    }
+    return best;
+  }
+};
+
+
+namespace cut_scan_detail {
+
+// Single and pairwise yields of one sample.
+void FillSingleAndPairYields(const ScanSample &sample,
+                             const std::vector<std::vector<EventMask> > &masks,
+                             const std::vector<ScanCut> &cuts,
+                             std::vector<std::vector<Double_t> > &single,
+                             std::vector<std::vector<Double_t> > &pair) {
+  int n_cuts = cuts.size();
+  size_t n_words = masks.empty() || masks[0].empty() ? 0 : masks[0][0].size();
+  const Float_t *w = sample.weight.data();
+
+  single.assign(n_cuts, std::vector<Double_t>());
+  pair.assign(n_cuts*n_cuts, std::vector<Double_t>());
+  for (int i = 0; i < n_cuts; ++i) {
+    int n_i = cuts[i].thresholds.size();
+    single[i].assign(n_i, 0.);
+    for (int ti = 0; ti < n_i; ++ti) {
+      const ULong64_t *mi = masks[i][ti].data();
+      for (size_t k = 0; k < n_words; ++k) single[i][ti] += MaskedSum(mi[k], w + 64*k);
+    }
+    for (int j = i + 1; j < n_cuts; ++j) {
+      int n_j = cuts[j].thresholds.size();
+      std::vector<Double_t> &yield = pair[i*n_cuts + j];
+      yield.assign(n_i*n_j, 0.);
+      for (int ti = 0; ti < n_i; ++ti) {
+        const ULong64_t *mi = masks[i][ti].data();
+        for (int tj = 0; tj < n_j; ++tj) {
+          const ULong64_t *mj = masks[j][tj].data();
+          Double_t sum = 0;
+          for (size_t k = 0; k < n_words; ++k) sum += MaskedSum(mi[k] & mj[k], w + 64*k);
+          yield[ti*n_j + tj] = sum;
+        }
+      }
+    }
+  }
+}
+
+
+// Yields of point `index` for one sample: all cuts, and N-1 for each cut.
+void FillPointYields(const ScanSample &sample,
+                     const std::vector<std::vector<EventMask> > &masks,
+                     const std::vector<int> &index, Double_t &all,
+                     std::vector<Double_t> &nm1) {
+  int n_cuts = index.size();
+  size_t n_words = n_cuts == 0 ? 0 : masks[0][0].size();
+  const Float_t *w = sample.weight.data();
+
+  std::vector<const ULong64_t*> m(n_cuts);
+  for (int c = 0; c < n_cuts; ++c) m[c] = masks[c][index[c]].data();
+  std::vector<ULong64_t> suffix(n_cuts + 1);
+
+  // Bits of the last word past the end of the sample are not events.
+  int tail = sample.size() % 64;
+
+  all = 0;
+  nm1.assign(n_cuts, 0.);
+  for (size_t k = 0; k < n_words; ++k) {
+    ULong64_t valid = (k + 1 == n_words && tail) ? (1ULL << tail) - 1 : ~0ULL;
+    // N-1 masks from prefix and suffix ANDs.
+    suffix[n_cuts] = valid;
+    for (int c = n_cuts - 1; c >= 0; --c) suffix[c] = suffix[c + 1] & m[c][k];
+    ULong64_t prefix = valid;
+    for (int c = 0; c < n_cuts; ++c) {
+      ULong64_t others = prefix & suffix[c + 1];
+      if (others) nm1[c] += MaskedSum(others, w + 64*k);
+      prefix &= m[c][k];
+    }
+    if (prefix) all += MaskedSum(prefix, w + 64*k);
+  }
+}
+
+}  // namespace cut_scan_detail
+
+
+// Evaluates every point of the grid spanned by the thresholds of `cuts`.
+CutScanResult RunCutScan(const std::vector<ScanCut> &cuts,
+                         const ScanSample &signal, const ScanSample &background) {
+  CutScanResult result;
+  result.cuts = cuts;
+  int n_cuts = cuts.size();
+
+  Long64_t n_points = n_cuts > 0 ? 1 : 0;
+  for (const ScanCut &cut : cuts) n_points *= cut.thresholds.size();
+  printf("Scanning %lld points of %d cuts over %lld signal and %lld background events \n",
+         n_points, n_cuts, signal.size(), background.size());
+  if (n_points == 0) return result;
+
+  std::vector<std::vector<EventMask> > s_masks = BuildPassMasks(signal, cuts);
+  std::vector<std::vector<EventMask> > b_masks = BuildPassMasks(background, cuts);
+
+  for (Float_t w : signal.weight) result.s_total += w;
+  for (Float_t w : background.weight) result.b_total += w;
+  cut_scan_detail::FillSingleAndPairYields(signal, s_masks, cuts,
+                                           result.s_single, result.s_pair);
+  cut_scan_detail::FillSingleAndPairYields(background, b_masks, cuts,
+                                           result.b_single, result.b_pair);
+
+  // Walk the grid, last cut fastest.
+  result.points.reserve(n_points);
+  std::vector<int> index(n_cuts, 0);
+  for (Long64_t p = 0; p < n_points; ++p) {
+    ScanPoint point;
+    point.index = index;
+    cut_scan_detail::FillPointYields(signal, s_masks, index, point.s, point.s_nm1);
+    cut_scan_detail::FillPointYields(background, b_masks, index, point.b, point.b_nm1);
+    point.significance = AsimovSignificance(point.s, point.b);
+    result.points.push_back(point);
+
+    for (int c = n_cuts - 1; c >= 0; --c) {
+      if (++index[c] < (int) cuts[c].thresholds.size()) break;
+      index[c] = 0;
+    }
+  }
+  return result;
+}
+
+
+inline Double_t SafeRatio(Double_t num, Double_t den) {
+  return den > 0 ? num / den : 0;
+}
+
+
+// Prints the thresholds, yields, N-1 efficiencies and pairwise efficiency
+// matrices of one grid point.
+void PrintScanPoint(const CutScanResult &result, const ScanPoint &p) {
+  int n_cuts = result.cuts.size();
+  for (int c = 0; c < n_cuts; ++c) {
+    const ScanCut &cut = result.cuts[c];
+    printf("  %s %s %g \n", cut.name.c_str(), cut.direction == kPassAbove ? ">" : "<",
+           cut.thresholds[p.index[c]]);
+  }
+  printf("  S = %g (eff %f), B = %g (eff %f), Z = %f \n",
+         p.s, SafeRatio(p.s, result.s_total), p.b, SafeRatio(p.b, result.b_total),
+         p.significance);
+
+  printf("  N-1 efficiency (signal, background): \n");
+  for (int c = 0; c < n_cuts; ++c) {
+    printf("    %-20s %f %f \n", result.cuts[c].name.c_str(),
+           SafeRatio(p.s, p.s_nm1[c]), SafeRatio(p.b, p.b_nm1[c]));
+  }
+
+  for (int signal = 1; signal >= 0; --signal) {
+    Double_t total = signal ? result.s_total : result.b_total;
+    printf("  %s efficiency matrix (cuts i and j): \n", signal ? "Signal" : "Background");
+    for (int i = 0; i < n_cuts; ++i) {
+      printf("   ");
+      for (int j = 0; j < n_cuts; ++j) {
+        printf(" %f", SafeRatio(result.PairYield(signal, p, i, j), total));
+      }
+      printf("\n");
+    }
+  }
+}
+
+
+// Writes one tab-separated line per grid point: thresholds, yields,
+// significance, N-1 efficiencies of each cut and pairwise efficiencies.
+bool WriteCutScan(const CutScanResult &result, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  int n_cuts = result.cuts.size();
+
+  for (const ScanCut &cut : result.cuts) fprintf(out, "%s\t", cut.name.c_str());
+  fprintf(out, "s\tb\tz\ts_eff\tb_eff");
+  for (const ScanCut &cut : result.cuts) {
+    fprintf(out, "\ts_nm1_%s\tb_nm1_%s", cut.name.c_str(), cut.name.c_str());
+  }
+  for (int i = 0; i < n_cuts; ++i) {
+    for (int j = i + 1; j < n_cuts; ++j) {
+      const char *a = result.cuts[i].name.c_str();
+      const char *b = result.cuts[j].name.c_str();
+      fprintf(out, "\ts_%s_%s\tb_%s_%s", a, b, a, b);
+    }
+  }
+  fprintf(out, "\n");
+
+  for (const ScanPoint &p : result.points) {
+    for (int c = 0; c < n_cuts; ++c) fprintf(out, "%g\t", result.cuts[c].thresholds[p.index[c]]);
+    fprintf(out, "%g\t%g\t%g\t%g\t%g", p.s, p.b, p.significance,
+            SafeRatio(p.s, result.s_total), SafeRatio(p.b, result.b_total));
+    for (int c = 0; c < n_cuts; ++c) {
+      fprintf(out, "\t%g\t%g", SafeRatio(p.s, p.s_nm1[c]), SafeRatio(p.b, p.b_nm1[c]));
+    }
+    for (int i = 0; i < n_cuts; ++i) {
+      for (int j = i + 1; j < n_cuts; ++j) {
+        fprintf(out, "\t%g\t%g", SafeRatio(result.PairYield(true, p, i, j), result.s_total),
+                SafeRatio(result.PairYield(false, p, i, j), result.b_total));
+      }
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  printf("Wrote %zu scan points to %s \n", result.points.size(), path);
+  return true;
+}
+
+
+// Evenly spaced thresholds lo, lo + step, ..., up to hi.
+std::vector<Float_t> ThresholdRange(Float_t lo, Float_t hi, Float_t step) {
+  std::vector<Float_t> t;
+  int n = (int) std::floor((hi - lo)/step + 0.5) + 1;
+  for (int k = 0; k < n; ++k) t.push_back(lo + k*step);
+  return t;
+}
+
+#endif
@@ -0,0 +1,223 @@
+// Spatial index for DeltaR matching in (eta, phi).
+//
+// EtaPhiGrid buckets a set of target points into square-ish cells of
+// (eta, phi), with phi wrapping around. A lookup only visits the cells
+// within the search radius, so matching n objects against m candidates
+// costs about n times the few candidates near each object, not n*m
+// DeltaR evaluations. Points are taken from cached (eta, phi) arrays, so
+// no TLorentzVector is built.
+//
+// MatchEtaPhi() matches a set of query points to the grid:
+//   kBestMatch  each query takes its nearest target within the radius;
+//               several queries may share a target.
+//   kOneToOne   pairs are assigned in increasing DeltaR, each target and
+//               each query used at most once.
+// Ties go to the lower target index, as with a plain loop using `<`.
+//
+// Nothing here depends on Delphes; the grid and match buffers can be kept
+// across events, so steady-state lookups do not allocate.
+
+#ifndef ETA_PHI_GRID_H
+#define ETA_PHI_GRID_H
+
+#include <TMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+// phi mapped to [-pi, pi).
+inline Double_t WrapPhi(Double_t phi) {
+  if (phi >= -TMath::Pi() && phi < TMath::Pi()) return phi;
+  phi = std::fmod(phi + TMath::Pi(), TMath::TwoPi());
+  if (phi < 0) phi += TMath::TwoPi();
+  return phi - TMath::Pi();
+}
+
+
+inline Double_t DeltaR2(Double_t eta1, Double_t phi1, Double_t eta2, Double_t phi2) {
+  Double_t deta = eta1 - eta2;
+  Double_t dphi = std::fabs(WrapPhi(phi1) - WrapPhi(phi2));
+  if (dphi > TMath::Pi()) dphi = TMath::TwoPi() - dphi;
+  return deta*deta + dphi*dphi;
+}
+
+
+// A list of (eta, phi) points.
+struct EtaPhiPoints {
+  std::vector<Double_t> eta, phi;
+
+  void clear() {
+    eta.clear();
+    phi.clear();
+  }
+  void push_back(Double_t e, Double_t p) {
+    eta.push_back(e);
+    phi.push_back(p);
+  }
+  int size() const { return eta.size(); }
+};
+
+
+class EtaPhiGrid {
+ public:
+  // Cells are `cell_size` wide in eta and at least that in phi. Points
+  // beyond |eta| = `eta_max` share the edge cells.
+  EtaPhiGrid(Double_t cell_size = 0.4, Double_t eta_max = 5.)
+      : cell_size(cell_size), eta_max(eta_max) {
+    n_eta = std::max(1, (int) std::ceil(2*eta_max / cell_size));
+    n_phi = std::max(1, (int) std::floor(TMath::TwoPi() / cell_size));
+    phi_width = TMath::TwoPi() / n_phi;
+  }
+
+  // Indexes `points`, replacing what was there.
+  void Build(const EtaPhiPoints &points) {
+    int n = points.size();
+    cell_start.assign(n_eta*n_phi + 1, 0);
+    cell_of.resize(n);
+    for (int i = 0; i < n; ++i) {
+      cell_of[i] = Cell(EtaCell(points.eta[i]), PhiCell(WrapPhi(points.phi[i])));
+      cell_start[cell_of[i] + 1]++;
+    }
+    for (int c = 0; c < n_eta*n_phi; ++c) cell_start[c + 1] += cell_start[c];
+
+    // Counting sort into cell order; within a cell, points stay in index order.
+    eta.resize(n);
+    phi.resize(n);
+    index.resize(n);
+    fill.assign(cell_start.begin(), cell_start.end() - 1);
+    for (int i = 0; i < n; ++i) {
+      int k = fill[cell_of[i]]++;
+      eta[k] = points.eta[i];
+      phi[k] = WrapPhi(points.phi[i]);
+      index[k] = i;
+    }
+  }
+
+  int size() const { return index.size(); }
+
+  // Calls visit(target_index, dr2) for every point within `r` of (eta, phi).
+  template <class Visitor>
+  void ForEachWithin(Double_t query_eta, Double_t query_phi, Double_t r, Visitor visit) const {
+    if (index.empty()) return;
+    query_phi = WrapPhi(query_phi);
+    Double_t r2 = r*r;
+    int eta_lo = EtaCell(query_eta - r);
+    int eta_hi = EtaCell(query_eta + r);
+    int phi_reach = (int) std::ceil(r / phi_width);
+    int phi_center = PhiCell(query_phi);
+    int phi_lo = phi_center - phi_reach;
+    int phi_hi = phi_center + phi_reach;
+    if (phi_hi - phi_lo + 1 >= n_phi) {
+      phi_lo = 0;
+      phi_hi = n_phi - 1;
+    }
+
+    for (int ie = eta_lo; ie <= eta_hi; ++ie) {
+      for (int ip = phi_lo; ip <= phi_hi; ++ip) {
+        int c = Cell(ie, ((ip % n_phi) + n_phi) % n_phi);
+        for (int k = cell_start[c]; k < cell_start[c + 1]; ++k) {
+          Double_t dr2 = DeltaR2(query_eta, query_phi, eta[k], phi[k]);
+          if (dr2 < r2) visit(index[k], dr2);
+        }
+      }
+    }
+  }
+
+  // Nearest point within `r` that is not `taken`, or -1. Its DeltaR goes
+  // to `dr` if given.
+  int Nearest(Double_t query_eta, Double_t query_phi, Double_t r,
+              const std::vector<char> *taken = 0, Double_t *dr = 0) const {
+    int best = -1;
+    Double_t best_dr2 = 0;
+    ForEachWithin(query_eta, query_phi, r, [&](int i, Double_t dr2) {
+      if (taken && (*taken)[i]) return;
+      if (best < 0 || dr2 < best_dr2 || (dr2 == best_dr2 && i < best)) {
+        best = i;
+        best_dr2 = dr2;
+      }
+    });
+    if (dr) *dr = best >= 0 ? std::sqrt(best_dr2) : -1.;
+    return best;
+  }
+
+ private:
+  int EtaCell(Double_t e) const {
+    int c = (int) std::floor((e + eta_max) / cell_size);
+    return std::min(std::max(c, 0), n_eta - 1);
+  }
+  int PhiCell(Double_t p) const {
+    int c = (int) ((p + TMath::Pi()) / phi_width);
+    return std::min(std::max(c, 0), n_phi - 1);
+  }
+  int Cell(int ie, int ip) const { return ie*n_phi + ip; }
+
+  Double_t cell_size, eta_max, phi_width;
+  int n_eta, n_phi;
+  std::vector<int> cell_start, cell_of, fill, index;
+  std::vector<Double_t> eta, phi;
+};
+
+
+enum MatchMode {
+  kBestMatch,
+  kOneToOne
+};
+
+
+// Reusable buffers for kOneToOne matching.
+struct MatchScratch {
+  struct Pair {
+    Double_t dr2;
+    int query, target;
+    bool operator<(const Pair &o) const {
+      if (dr2 != o.dr2) return dr2 < o.dr2;
+      if (target != o.target) return target < o.target;
+      return query < o.query;
+    }
+  };
+  std::vector<Pair> pairs;
+  std::vector<char> query_used, target_used;
+};
+
+
+// match[i] is the target matched to query i within `r`, or -1; dr[i] (if
+// given) its DeltaR, or -1.
+void MatchEtaPhi(const EtaPhiPoints &queries, const EtaPhiGrid &targets, Double_t r,
+                 MatchMode mode, std::vector<int> &match, std::vector<Double_t> *dr = 0,
+                 MatchScratch *scratch = 0) {
+  int n = queries.size();
+  match.assign(n, -1);
+  if (dr) dr->assign(n, -1.);
+
+  if (mode == kBestMatch) {
+    for (int i = 0; i < n; ++i) {
+      Double_t d;
+      match[i] = targets.Nearest(queries.eta[i], queries.phi[i], r, 0, &d);
+      if (dr) (*dr)[i] = d;
+    }
+    return;
+  }
+
+  MatchScratch local;
+  MatchScratch &s = scratch ? *scratch : local;
+  s.pairs.clear();
+  for (int i = 0; i < n; ++i) {
+    targets.ForEachWithin(queries.eta[i], queries.phi[i], r, [&](int t, Double_t dr2) {
+      MatchScratch::Pair p = {dr2, i, t};
+      s.pairs.push_back(p);
+    });
+  }
+  std::sort(s.pairs.begin(), s.pairs.end());
+  s.query_used.assign(n, 0);
+  s.target_used.assign(targets.size(), 0);
+  for (const MatchScratch::Pair &p : s.pairs) {
+    if (s.query_used[p.query] || s.target_used[p.target]) continue;
+    s.query_used[p.query] = s.target_used[p.target] = 1;
+    match[p.query] = p.target;
+    if (dr) (*dr)[p.query] = std::sqrt(p.dr2);
+  }
+}
+
+#endif
@@ -0,0 +1,243 @@
+// Compact event cache written by Cutflow.C alongside the flat skim tree.
+//
+// The flat skim keeps six 4-vectors per selected event, so any new variable
+// means re-running over the Delphes files. The cache instead keeps, for
+// every event with at least one tau-tagged jet, one b-tagged jet and two
+// leptons (after the pT floors below, before any of the skim's cuts), all
+// jets and leptons in counted fixed-width arrays: kinematics, tags, charges
+// and lepton flavour, plus MET and the event weight. Baskets are LZ4
+// compressed, which costs little to decompress.
+//
+// Branches of the "cache" tree:
+//
+//   Weight/F  MET/F  METPhi/F
+//   NJet/I  JetPT[NJet]/F  JetEta  JetPhi  JetMass  JetFlags[NJet]/b  JetCharge[NJet]/B
+//   NLep/I  LepPT[NLep]/F  LepEta  LepPhi  LepCharge[NLep]/B  LepFlavour[NLep]/b
+//
+// An event keeps at most kCacheMaxJets jets and kCacheMaxLeptons leptons
+// (electrons first), so a selection redone on the cache can differ from the
+// skim for events with more; Cutflow() reports how many were cut short.
+//
+// Jet and lepton 4-vectors are those of Jet::P4() (PtEtaPhiM with the jet
+// mass) and Electron/Muon::P4() (massless). Electrons come before muons, each
+// in Delphes order. A sample skimmed in slices has one cache file per slice,
+// <dir>/<sample>_<slice>.root (slice as 000, 001, ...); chaining them in slice order gives the
+// events in chain order.
+//
+// LoadEventCache() reads a whole cache into flat in-memory columns, so
+// studies can redo selections and variables at memory speed.
+
+#ifndef EVENT_CACHE_H
+#define EVENT_CACHE_H
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TBranch.h>
+#include <TChain.h>
+#include <TObjArray.h>
+#include <TSystem.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+const int kCacheMaxJets = 16;
+const int kCacheMaxLeptons = 8;
+const Float_t kCacheJetMinPT = 15.;     // GeV
+const Float_t kCacheLeptonMinPT = 10.;  // GeV
+const int kEventCacheCompression = 404;  // ROOT::CompressionSettings(ROOT::kLZ4, 4)
+
+// Bits of JetFlags.
+const UChar_t kJetBTag = 1 << 0;
+const UChar_t kJetTauTag = 1 << 1;
+
+
+// Branch buffers of one cached event.
+struct CachedEvent {
+  Float_t weight;
+  Float_t met, met_phi;
+
+  Int_t n_jet;
+  Float_t jet_pt[kCacheMaxJets], jet_eta[kCacheMaxJets];
+  Float_t jet_phi[kCacheMaxJets], jet_mass[kCacheMaxJets];
+  UChar_t jet_flags[kCacheMaxJets];
+  Char_t jet_charge[kCacheMaxJets];
+
+  Int_t n_lep;
+  Float_t lep_pt[kCacheMaxLeptons], lep_eta[kCacheMaxLeptons], lep_phi[kCacheMaxLeptons];
+  Char_t lep_charge[kCacheMaxLeptons];
+  UChar_t lep_flavour[kCacheMaxLeptons];  // 11 or 13.
+
+  bool truncated;  // Not stored: jets or leptons past the capacity were dropped.
+};
+
+
+// Books the cache tree in the current directory, with LZ4 baskets.
+TTree *BookEventCache(CachedEvent &ev) {
+  TTree *tree = new TTree("cache", "Skim event cache");
+  tree->Branch("Weight", &ev.weight, "Weight/F");
+  tree->Branch("MET", &ev.met, "MET/F");
+  tree->Branch("METPhi", &ev.met_phi, "METPhi/F");
+  tree->Branch("NJet", &ev.n_jet, "NJet/I");
+  tree->Branch("JetPT", ev.jet_pt, "JetPT[NJet]/F");
+  tree->Branch("JetEta", ev.jet_eta, "JetEta[NJet]/F");
+  tree->Branch("JetPhi", ev.jet_phi, "JetPhi[NJet]/F");
+  tree->Branch("JetMass", ev.jet_mass, "JetMass[NJet]/F");
+  tree->Branch("JetFlags", ev.jet_flags, "JetFlags[NJet]/b");
+  tree->Branch("JetCharge", ev.jet_charge, "JetCharge[NJet]/B");
+  tree->Branch("NLep", &ev.n_lep, "NLep/I");
+  tree->Branch("LepPT", ev.lep_pt, "LepPT[NLep]/F");
+  tree->Branch("LepEta", ev.lep_eta, "LepEta[NLep]/F");
+  tree->Branch("LepPhi", ev.lep_phi, "LepPhi[NLep]/F");
+  tree->Branch("LepCharge", ev.lep_charge, "LepCharge[NLep]/B");
+  tree->Branch("LepFlavour", ev.lep_flavour, "LepFlavour[NLep]/b");
+
+  TObjArray *branches = tree->GetListOfBranches();
+  for (int i = 0; i < branches->GetEntries(); ++i) {
+    ((TBranch*) branches->At(i))->SetCompressionSettings(kEventCacheCompression);
+  }
+  return tree;
+}
+
+
+void SetEventCacheAddresses(TTree *tree, CachedEvent &ev) {
+  tree->SetBranchAddress("Weight", &ev.weight);
+  tree->SetBranchAddress("MET", &ev.met);
+  tree->SetBranchAddress("METPhi", &ev.met_phi);
+  tree->SetBranchAddress("NJet", &ev.n_jet);
+  tree->SetBranchAddress("JetPT", ev.jet_pt);
+  tree->SetBranchAddress("JetEta", ev.jet_eta);
+  tree->SetBranchAddress("JetPhi", ev.jet_phi);
+  tree->SetBranchAddress("JetMass", ev.jet_mass);
+  tree->SetBranchAddress("JetFlags", ev.jet_flags);
+  tree->SetBranchAddress("JetCharge", ev.jet_charge);
+  tree->SetBranchAddress("NLep", &ev.n_lep);
+  tree->SetBranchAddress("LepPT", ev.lep_pt);
+  tree->SetBranchAddress("LepEta", ev.lep_eta);
+  tree->SetBranchAddress("LepPhi", ev.lep_phi);
+  tree->SetBranchAddress("LepCharge", ev.lep_charge);
+  tree->SetBranchAddress("LepFlavour", ev.lep_flavour);
+}
+
+
+// Path of the cache file of one slice of a sample.
+std::string EventCachePath(const char *dir, const std::string &sample, int slice) {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "_%03d.root", slice);
+  return std::string(dir) + "/" + sample + suffix;
+}
+
+
+// Deletes the slice files of `sample` under `dir`, so a rerun with fewer
+// slices leaves no stale ones behind.
+void RemoveEventCache(const char *dir, const std::string &sample) {
+  for (int slice = 0; ; ++slice) {
+    std::string path = EventCachePath(dir, sample, slice);
+    if (gSystem->AccessPathName(path.c_str())) break;
+    gSystem->Unlink(path.c_str());
+  }
+}
+
+
+// Creates the cache file of one slice; book the tree with the file as the
+// current directory.
+TFile *OpenEventCacheFile(const char *dir, const std::string &sample, int slice) {
+  std::string path = EventCachePath(dir, sample, slice);
+  TFile *file = TFile::Open(path.c_str(), "RECREATE");
+  if (!file || file->IsZombie()) {
+    printf("Cannot create event cache %s \n", path.c_str());
+    delete file;
+    return 0;
+  }
+  return file;
+}
+
+
+// Writes `tree` to its file and closes it; deletes both.
+void CloseEventCacheFile(TFile *file, TTree *tree) {
+  if (tree) {
+    tree->Write();
+    printf("Wrote %lld events to %s \n", tree->GetEntries(), file->GetName());
+  }
+  file->Close();
+  delete file;
+}
+
+
+// A whole cache in memory. Per-event columns have one entry per event; jet
+// and lepton columns are flat, event i owning [jet_begin[i], jet_begin[i+1]).
+struct EventCacheColumns {
+  std::vector<Float_t> weight, met, met_phi;
+
+  std::vector<Long64_t> jet_begin;
+  std::vector<Float_t> jet_pt, jet_eta, jet_phi, jet_mass;
+  std::vector<UChar_t> jet_flags;
+  std::vector<Char_t> jet_charge;
+
+  std::vector<Long64_t> lep_begin;
+  std::vector<Float_t> lep_pt, lep_eta, lep_phi;
+  std::vector<Char_t> lep_charge;
+  std::vector<UChar_t> lep_flavour;
+
+  Long64_t size() const { return weight.size(); }
+};
+
+
+// Reads every entry of `tree` (a cache tree or a TChain of them) into
+// `out`, appending to what is already there.
+Long64_t LoadEventCache(TTree *tree, EventCacheColumns &out) {
+  CachedEvent ev;
+  SetEventCacheAddresses(tree, ev);
+
+  Long64_t n = tree->GetEntries();
+  out.weight.reserve(out.weight.size() + n);
+  out.met.reserve(out.met.size() + n);
+  out.met_phi.reserve(out.met_phi.size() + n);
+  if (out.jet_begin.empty()) out.jet_begin.push_back(0);
+  if (out.lep_begin.empty()) out.lep_begin.push_back(0);
+
+  for (Long64_t i = 0; i < n; ++i) {
+    tree->GetEntry(i);
+    out.weight.push_back(ev.weight);
+    out.met.push_back(ev.met);
+    out.met_phi.push_back(ev.met_phi);
+
+    out.jet_pt.insert(out.jet_pt.end(), ev.jet_pt, ev.jet_pt + ev.n_jet);
+    out.jet_eta.insert(out.jet_eta.end(), ev.jet_eta, ev.jet_eta + ev.n_jet);
+    out.jet_phi.insert(out.jet_phi.end(), ev.jet_phi, ev.jet_phi + ev.n_jet);
+    out.jet_mass.insert(out.jet_mass.end(), ev.jet_mass, ev.jet_mass + ev.n_jet);
+    out.jet_flags.insert(out.jet_flags.end(), ev.jet_flags, ev.jet_flags + ev.n_jet);
+    out.jet_charge.insert(out.jet_charge.end(), ev.jet_charge, ev.jet_charge + ev.n_jet);
+    out.jet_begin.push_back(out.jet_pt.size());
+
+    out.lep_pt.insert(out.lep_pt.end(), ev.lep_pt, ev.lep_pt + ev.n_lep);
+    out.lep_eta.insert(out.lep_eta.end(), ev.lep_eta, ev.lep_eta + ev.n_lep);
+    out.lep_phi.insert(out.lep_phi.end(), ev.lep_phi, ev.lep_phi + ev.n_lep);
+    out.lep_charge.insert(out.lep_charge.end(), ev.lep_charge, ev.lep_charge + ev.n_lep);
+    out.lep_flavour.insert(out.lep_flavour.end(), ev.lep_flavour, ev.lep_flavour + ev.n_lep);
+    out.lep_begin.push_back(out.lep_pt.size());
+  }
+  tree->ResetBranchAddresses();
+  return n;
+}
+
+
+// Loads the cache of `sample`: slice files 0, 1, ... under `dir`, up to the
+// first missing one.
+Long64_t LoadEventCache(const char *dir, const std::string &sample,
+                        EventCacheColumns &out) {
+  TChain chain("cache");
+  for (int slice = 0; ; ++slice) {
+    std::string path = EventCachePath(dir, sample, slice);
+    if (gSystem->AccessPathName(path.c_str())) break;  // true if missing.
+    chain.Add(path.c_str());
+  }
+  if (chain.GetNtrees() == 0) {
+    printf("No event cache for %s in %s \n", sample.c_str(), dir);
+    return 0;
+  }
+  return LoadEventCache(&chain, out);
+}
+
+#endif
@@ -0,0 +1,197 @@
+// Runs a list of histogram fits on a pool of threads.
+//
+// Each FitEntry pairs a histogram with a model TF1 that already holds its
+// seed parameters, names and limits. Entries sharing a `chain` name are one
+// mass scan: they are fitted in order of `mass`, each starting from the
+// converged parameters of the point before it, with the parameters listed
+// in `mass_scaled` (e.g. the peak position and width) scaled by the mass
+// ratio. A warm start that fails is refitted from the entry's own seed.
+// Different chains (and entries with no chain) run concurrently.
+//
+// Histograms and TF1s must be created on the calling thread; RunFits()
+// only fits them, so it can be used from a macro without any locking.
+// Results come back in entry order and can be written as a TSV table.
+
+#ifndef FIT_SERVICE_H
+#define FIT_SERVICE_H
+
+#include <TROOT.h>
+#include <TF1.h>
+#include <TH1.h>
+#include <Math/MinimizerOptions.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct FitEntry {
+  std::string name;
+  TH1 *hist;
+  TF1 *model;                    // Seeded; fitted in place.
+  std::string chain;             // Empty: fitted on its own.
+  Double_t mass = 0;             // Order within the chain.
+  std::vector<int> mass_scaled;  // Parameters warm-started as p * mass / previous mass.
+};
+
+
+struct FitOutcome {
+  std::string name;
+  Double_t mass = 0;
+  int status = -1;               // TH1::Fit status; 0 is a good fit.
+  bool warm_started = false;     // Converged from the previous mass point.
+  Double_t chi2 = 0;
+  int ndf = 0;
+  Double_t prob = 0;
+  Double_t integral = 0;         // Histogram integral.
+  std::vector<std::string> par_names;
+  std::vector<Double_t> par, err;
+};
+
+
+namespace fit_service_detail {
+
+FitOutcome FitOne(const FitEntry &entry, const char *options, const FitEntry *previous) {
+  TF1 *f = entry.model;
+  int npar = f->GetNpar();
+  std::vector<Double_t> seed(f->GetParameters(), f->GetParameters() + npar);
+
+  FitOutcome out;
+  out.name = entry.name;
+  out.mass = entry.mass;
+  if (previous && previous->mass > 0) {
+    std::vector<Double_t> start(previous->model->GetParameters(),
+                                previous->model->GetParameters() + npar);
+    for (int k : entry.mass_scaled) start[k] *= entry.mass / previous->mass;
+    f->SetParameters(start.data());
+    out.status = entry.hist->Fit(f, options);
+    out.warm_started = out.status == 0;
+  }
+  if (out.status != 0) {
+    f->SetParameters(seed.data());
+    out.status = entry.hist->Fit(f, options);
+  }
+
+  out.chi2 = f->GetChisquare();
+  out.ndf = f->GetNDF();
+  out.prob = f->GetProb();
+  out.integral = entry.hist->Integral();
+  for (int k = 0; k < npar; ++k) {
+    out.par_names.push_back(f->GetParName(k));
+    out.par.push_back(f->GetParameter(k));
+    out.err.push_back(f->GetParError(k));
+  }
+  return out;
+}
+
+}  // namespace fit_service_detail
+
+
+// Fits every entry; `options` are TH1::Fit options ("Q" and "N" are added
+// so worker threads neither print nor attach the function to the
+// histogram). With more than one thread the minimizer is Minuit2, since
+// TMinuit is not thread safe; the previous default is restored on return.
+std::vector<FitOutcome> RunFits(const std::vector<FitEntry> &entries,
+                                int n_threads = 1, const char *options = "RF") {
+  // Group entries into chains, each ordered by mass.
+  std::vector<std::vector<int> > chains;
+  std::map<std::string, int> chain_index;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const std::string &name = entries[i].chain;
+    if (name.empty()) {
+      chains.push_back(std::vector<int>(1, i));
+      continue;
+    }
+    if (!chain_index.count(name)) {
+      chain_index[name] = chains.size();
+      chains.push_back(std::vector<int>());
+    }
+    chains[chain_index[name]].push_back(i);
+  }
+  for (std::vector<int> &chain : chains) {
+    std::stable_sort(chain.begin(), chain.end(), [&](int a, int b) {
+      return entries[a].mass < entries[b].mass;
+    });
+  }
+
+  std::string fit_options = std::string(options) + "QN";
+  std::vector<FitOutcome> outcomes(entries.size());
+  auto fit_chain = [&](const std::vector<int> &chain) {
+    const FitEntry *previous = 0;
+    for (int i : chain) {
+      outcomes[i] = fit_service_detail::FitOne(entries[i], fit_options.c_str(), previous);
+      previous = outcomes[i].status == 0 ? &entries[i] : 0;
+    }
+  };
+
+  if (n_threads > (int) chains.size()) n_threads = chains.size();
+  if (n_threads <= 1) {
+    for (const std::vector<int> &chain : chains) fit_chain(chain);
+    return outcomes;
+  }
+
+  // The default minimizer is process-wide: restore it for later fits.
+  std::string previous_type = ROOT::Math::MinimizerOptions::DefaultMinimizerType();
+  std::string previous_algo = ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo();
+  ROOT::EnableThreadSafety();
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int w = 0; w < n_threads; ++w) {
+    workers.emplace_back([&]() {
+      for (size_t c = next++; c < chains.size(); c = next++) fit_chain(chains[c]);
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer(previous_type.c_str(),
+                                                    previous_algo.c_str());
+  return outcomes;
+}
+
+
+// Prints chi2/ndf, p-value and integral of each fit.
+void PrintFitOutcomes(const std::vector<FitOutcome> &outcomes) {
+  for (const FitOutcome &o : outcomes) {
+    printf("%s: X^2/ndf = %f --- p = %f --- Integral = %f%s%s \n", o.name.c_str(),
+           o.ndf > 0 ? o.chi2 / o.ndf : 0., o.prob, o.integral,
+           o.status != 0 ? " --- FAILED" : "", o.warm_started ? " (warm start)" : "");
+  }
+}
+
+
+// Writes one tab-separated line per fit: name, mass, status, warm start,
+// chi2, ndf, p, integral, then each parameter and its error. Parameter
+// columns are headed by the names of the first fit, without ROOT's '#'.
+// `append` adds rows to an existing table without a new header.
+bool WriteFitTable(const std::vector<FitOutcome> &outcomes, const char *path,
+                   bool append = false) {
+  FILE *out = fopen(path, append ? "a" : "w");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  if (!append) {
+    fprintf(out, "name\tmass\tstatus\twarm_start\tchi2\tndf\tprob\tintegral");
+    if (!outcomes.empty()) {
+      for (std::string name : outcomes[0].par_names) {
+        name.erase(std::remove(name.begin(), name.end(), '#'), name.end());
+        fprintf(out, "\t%s\t%s_err", name.c_str(), name.c_str());
+      }
+    }
+    fprintf(out, "\n");
+  }
+  for (const FitOutcome &o : outcomes) {
+    fprintf(out, "%s\t%g\t%d\t%d\t%g\t%d\t%g\t%g", o.name.c_str(), o.mass, o.status,
+            o.warm_started, o.chi2, o.ndf, o.prob, o.integral);
+    for (size_t k = 0; k < o.par.size(); ++k) fprintf(out, "\t%g\t%g", o.par[k], o.err[k]);
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  return true;
+}
+
+#endif
@@ -0,0 +1,200 @@
+// Lightweight four-vectors and the kinematic helpers of the analyzers.
+//
+// BasicFourVector<T> is a plain struct (no TObject, no virtual calls) that
+// keeps px, py, pz, E and, alongside them, pt, eta and phi, so each is
+// computed once per object instead of once per use. FourVector is the
+// Double_t version.
+//
+// Every value repeats the arithmetic of TLorentzVector/TVector3, in the
+// same order, as the columnar kernels (columnar_kinematics.h) do: vectors
+// built from (pt, eta, phi, E) recompute pt, eta and phi from the
+// components, Eta() is +-1e10 along the beam, M() and Mt() are negative
+// square roots for space-like vectors, and DeltaPhi() is
+// TVector2::Phi_mpi_pi of the difference. The row-wise and columnar
+// Analyzer loops therefore give bit-identical results.
+//
+// PairTable<N> computes DeltaPhi, cos(DeltaPhi) and DeltaR for all pairs
+// of N objects once per event.
+//
+// The helpers TransverseMass, TotalTransverseMass, DZeta and
+// PairedMassHypothesis are the TObject-free versions of Mt, GetTotalMT,
+// GetDZeta and MassHypothesis in Analyzer.C. ToFourVector() converts a
+// TLorentzVector, for analyzers that switch over one piece at a time.
+
+#ifndef FOUR_VECTOR_H
+#define FOUR_VECTOR_H
+
+#include <TLorentzVector.h>
+#include <TMath.h>
+#include <TVector2.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+template <class T>
+struct BasicFourVector {
+  T px = 0, py = 0, pz = 0, e = 0;
+  T pt = 0, eta = 0, phi = 0;
+
+  static BasicFourVector FromPtEtaPhiE(T pt, T eta, T phi, T e) {
+    BasicFourVector v;
+    T p = std::fabs(pt);
+    v.px = p * std::cos(phi);
+    v.py = p * std::sin(phi);
+    v.pz = p * std::sinh(eta);
+    v.e = e;
+    v.UpdatePtEtaPhi();
+    return v;
+  }
+
+  static BasicFourVector FromPtEtaPhiM(T pt, T eta, T phi, T m) {
+    BasicFourVector v = FromPtEtaPhiE(pt, eta, phi, 0);
+    T p2 = v.px*v.px + v.py*v.py + v.pz*v.pz;
+    v.e = m >= 0 ? std::sqrt(p2 + m*m) : std::sqrt(std::max(p2 - m*m, T(0)));
+    return v;
+  }
+
+  static BasicFourVector FromPxPyPzE(T px, T py, T pz, T e) {
+    BasicFourVector v;
+    v.px = px;
+    v.py = py;
+    v.pz = pz;
+    v.e = e;
+    v.UpdatePtEtaPhi();
+    return v;
+  }
+
+  // Recomputes pt, eta and phi from the components, as TVector3::Perp(),
+  // Phi() and PseudoRapidity() do.
+  void UpdatePtEtaPhi() {
+    pt = std::sqrt(px*px + py*py);
+    phi = (px == 0 && py == 0) ? T(0) : std::atan2(py, px);
+    T ptot = std::sqrt(px*px + py*py + pz*pz);
+    T cos_theta = ptot == 0 ? T(1) : pz/ptot;
+    if (cos_theta*cos_theta < 1) {
+      eta = T(-0.5)*std::log((1 - cos_theta)/(1 + cos_theta));
+    } else {
+      eta = pz == 0 ? T(0) : (pz > 0 ? T(10e10) : T(-10e10));
+    }
+  }
+
+  constexpr T Px() const { return px; }
+  constexpr T Py() const { return py; }
+  constexpr T Pz() const { return pz; }
+  constexpr T E() const { return e; }
+  constexpr T Pt() const { return pt; }
+  constexpr T Eta() const { return eta; }
+  constexpr T Phi() const { return phi; }
+
+  constexpr T P2() const { return px*px + py*py + pz*pz; }
+  constexpr T M2() const { return e*e - P2(); }
+  constexpr T Mt2() const { return e*e - pz*pz; }
+  T M() const { return SignedSqrt(M2()); }
+  T Mt() const { return SignedSqrt(Mt2()); }
+
+  BasicFourVector operator+(const BasicFourVector &o) const {
+    return FromPxPyPzE(px + o.px, py + o.py, pz + o.pz, e + o.e);
+  }
+
+  // (*this + o).M(), without filling in pt, eta and phi of the sum.
+  T PairMass(const BasicFourVector &o) const {
+    T sx = px + o.px, sy = py + o.py, sz = pz + o.pz, se = e + o.e;
+    return SignedSqrt(se*se - (sx*sx + sy*sy + sz*sz));
+  }
+
+  // phi - o.phi in [-pi, pi).
+  T DeltaPhi(const BasicFourVector &o) const {
+    return T(TVector2::Phi_mpi_pi(phi - o.phi));
+  }
+
+  T CosDeltaPhi(const BasicFourVector &o) const { return std::cos(DeltaPhi(o)); }
+
+  T DeltaR(const BasicFourVector &o) const {
+    T deta = eta - o.eta;
+    T dphi = DeltaPhi(o);
+    return std::sqrt(deta*deta + dphi*dphi);
+  }
+
+  static T SignedSqrt(T mm) { return mm < 0 ? -std::sqrt(-mm) : std::sqrt(mm); }
+};
+
+typedef BasicFourVector<Double_t> FourVector;
+
+
+inline FourVector ToFourVector(const TLorentzVector &v) {
+  return FourVector::FromPxPyPzE(v.Px(), v.Py(), v.Pz(), v.E());
+}
+
+
+// DeltaPhi, cos(DeltaPhi) and DeltaR of all pairs of N objects:
+// dphi[i][j] is objects[i].DeltaPhi(objects[j]).
+template <int N, class T = Double_t>
+struct PairTable {
+  T dphi[N][N];
+  T cos_dphi[N][N];
+  T dr[N][N];
+
+  void Compute(const BasicFourVector<T> (&objects)[N]) {
+    for (int i = 0; i < N; ++i) {
+      dphi[i][i] = 0;
+      cos_dphi[i][i] = 1;
+      dr[i][i] = 0;
+      const BasicFourVector<T> &a = objects[i];
+      for (int j = i + 1; j < N; ++j) {
+        const BasicFourVector<T> &b = objects[j];
+        dphi[i][j] = a.DeltaPhi(b);
+        dphi[j][i] = b.DeltaPhi(a);
+        cos_dphi[i][j] = std::cos(dphi[i][j]);
+        cos_dphi[j][i] = std::cos(dphi[j][i]);
+        dr[i][j] = dr[j][i] = a.DeltaR(b);
+      }
+    }
+  }
+};
+
+
+// Transverse mass of `k` and the missing momentum.
+template <class T>
+T TransverseMass(const BasicFourVector<T> &pt_miss, const BasicFourVector<T> &k) {
+  return std::sqrt(2 * k.pt * pt_miss.pt * (1 - std::cos(k.DeltaPhi(pt_miss))));
+}
+
+
+// Total transverse mass of two visible objects and the missing momentum.
+template <class T>
+T TotalTransverseMass(const BasicFourVector<T> &p1, const BasicFourVector<T> &p2,
+                      const BasicFourVector<T> &met) {
+  T scalar = p1.pt + p2.pt + met.pt;
+  return std::sqrt(scalar*scalar - (p1 + p2 + met).M2());
+}
+
+
+// p_zeta^miss - 0.85 * p_zeta^vis, with zeta the bisector of the two
+// visible objects in the transverse plane.
+template <class T>
+T DZeta(const BasicFourVector<T> &vis1, const BasicFourVector<T> &vis2,
+        const BasicFourVector<T> &pt_miss) {
+  T zeta_x = vis2.pt*vis1.px + vis1.pt*vis2.px;
+  T zeta_y = vis2.pt*vis1.py + vis1.pt*vis2.py;
+  T inv_zeta = 1 / std::sqrt(zeta_x*zeta_x + zeta_y*zeta_y);
+  T pt_vis_zeta = ((vis1.px + vis2.px)*zeta_x + (vis1.py + vis2.py)*zeta_y) * inv_zeta;
+  T pt_miss_zeta = (pt_miss.px*zeta_x + pt_miss.py*zeta_y) * inv_zeta;
+  return pt_miss_zeta - T(0.85) * pt_vis_zeta;
+}
+
+
+// Of the two (tau, jet) (ell, jet) pairings, takes the one with the
+// smaller signed mass difference and returns its larger pair mass.
+template <class T>
+T PairedMassHypothesis(const BasicFourVector<T> &tau, const BasicFourVector<T> &ell,
+                       const BasicFourVector<T> &jet1, const BasicFourVector<T> &jet2) {
+  T m11 = tau.PairMass(jet1);
+  T m22 = ell.PairMass(jet2);
+  T m12 = tau.PairMass(jet2);
+  T m21 = ell.PairMass(jet1);
+  if ((m11 - m22) < (m12 - m21)) return std::max(m11, m22);
+  return std::max(m12, m21);
+}
+
+#endif
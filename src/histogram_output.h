@@ -0,0 +1,105 @@
+// Histogram output for the analyzers.
+//
+// An analyzer job writes every histogram of a sample in one pass into a
+// single structured file, one directory per sample and one key per
+// variable:
+//
+//   analyzer_histograms.root:/<sample>/<variable>
+//
+// <variable> is the stem of the per-variable file the histogram used to be
+// written to (hist_lepton_pt, hist_MT2, ...). ExportPerVariableFiles()
+// turns a structured file back into that layout, <variable>.root holding
+// one key per sample, as read by Fitter.C and NPlotOverlay.C. It opens
+// each output file once for all samples.
+
+#ifndef HISTOGRAM_OUTPUT_H
+#define HISTOGRAM_OUTPUT_H
+
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TKey.h>
+#include <TH1.h>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+typedef std::pair<std::string, TH1*> NamedHistogram;
+typedef std::vector<NamedHistogram> NamedHistograms;
+
+const char *kStructuredHistogramFile = "analyzer_histograms.root";
+
+
+// Writes `hists` into directory `sample_desc` of `output_file`, replacing
+// the keys of an earlier run of the same sample.
+bool WriteSampleHistograms(const char *output_file, const char *sample_desc,
+                           const NamedHistograms &hists) {
+  TFile *f = TFile::Open(output_file, "UPDATE");
+  if (!f || f->IsZombie()) {
+    printf("Could not open %s \n", output_file);
+    return false;
+  }
+
+  TDirectory *dir = f->GetDirectory(sample_desc);
+  if (!dir) dir = f->mkdir(sample_desc);
+  for (const NamedHistogram &h : hists) {
+    dir->WriteTObject(h.second, h.first.c_str(), "Overwrite");
+  }
+
+  f->Close();
+  delete f;
+  printf("Wrote %zu histograms for %s to %s \n", hists.size(), sample_desc, output_file);
+  return true;
+}
+
+
+// Writes every <sample>/<variable> of `structured_file` into
+// <out_dir>/<variable>.root under key <sample>.
+bool ExportPerVariableFiles(const char *structured_file, const char *out_dir) {
+  TFile *in = TFile::Open(structured_file, "READ");
+  if (!in || in->IsZombie()) {
+    printf("Could not open %s \n", structured_file);
+    return false;
+  }
+
+  // variable -> (sample, histogram)
+  std::map<std::string, NamedHistograms> by_variable;
+  TIter next_sample(in->GetListOfKeys());
+  while (TKey *sample_key = (TKey*) next_sample()) {
+    if (strcmp(sample_key->GetClassName(), "TDirectoryFile") != 0) continue;
+    TDirectory *dir = in->GetDirectory(sample_key->GetName());
+
+    TIter next_variable(dir->GetListOfKeys());
+    while (TKey *key = (TKey*) next_variable()) {
+      TH1 *h = (TH1*) key->ReadObj();
+      h->SetDirectory(0);
+      by_variable[key->GetName()].push_back(NamedHistogram(sample_key->GetName(), h));
+    }
+  }
+  in->Close();
+  delete in;
+
+  for (auto &variable : by_variable) {
+    std::string path = std::string(out_dir) + "/" + variable.first + ".root";
+    TFile *out = TFile::Open(path.c_str(), "UPDATE");
+    if (!out || out->IsZombie()) {
+      printf("Could not open %s \n", path.c_str());
+      continue;
+    }
+    for (const NamedHistogram &h : variable.second) {
+      out->WriteTObject(h.second, h.first.c_str(), "Overwrite");
+      delete h.second;
+    }
+    out->Close();
+    delete out;
+  }
+
+  printf("Exported %zu variables from %s to %s \n", by_variable.size(), structured_file, out_dir);
+  return true;
+}
+
+#endif
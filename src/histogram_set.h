@@ -0,0 +1,365 @@
+// Declarative histogram booking and filling.
+//
+// An analyzer describes its histograms as a table of HistogramSpecs: the
+// key it is saved under, binning, the column(s) of its per-event block it
+// is filled from, whether it is weighted, the cuts an event must pass and
+// whether it is normalised to unit area before saving. A HistogramSet books
+// the TH1Fs/TH2Fs of a table and fills all of them from a block of events,
+// one tight loop per histogram over contiguous columns, with no per-event
+// TH1::Fill call. Adding a variable is one more line in the table.
+//
+// Bins, sum of squared weights, statistics and entries are those of
+// TH1F::Fill / TH2F::Fill (fixed binning, under/overflows not counted in
+// the statistics, which is the ROOT default), except that bin contents are
+// summed in Double_t and rounded to the Float_t bins once per Flush(), not
+// once per event. A job over part of the events can Write() its Double_t
+// bin sums for another to Add(), so a sum over jobs rounds the same totals
+// as a single pass. Double_t sums added in a different order can still
+// differ in their last bit: a merged bin differs from a single pass only if
+// that lands on a Float_t rounding boundary, and the sums of squared
+// weights and the statistics agree to Double_t rounding.
+//
+// A block type (e.g. KinematicsBlock in Analyzer.C) holds Column members
+// (columnar_kinematics.h) filled for events [0, n); a spec names them by
+// pointer to member. The set is told which Column holds the event weight
+// and which CutColumn holds the per-event cut bits.
+
+#ifndef HISTOGRAM_SET_H
+#define HISTOGRAM_SET_H
+
+#include <TDirectory.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TArrayD.h>
+#include <TVectorD.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "columnar_kinematics.h"
+#include "histogram_output.h"
+
+
+// One bit per cut an event passed.
+typedef UInt_t CutColumn[kColumnBlockSize];
+
+
+enum HistogramWeighting {
+  kUnweighted,
+  kEventWeight
+};
+
+
+template <class Block>
+struct HistogramSpec {
+  const char *key;    // Output key; 0 to keep the histogram out of the output.
+  const char *name;   // ROOT name.
+  std::string title;  // "title;x title;y title", as for the TH1 constructor.
+  int nbins;
+  Double_t lo, hi;
+  Column Block::*x;
+  int nbins_y;        // 2D only.
+  Double_t lo_y, hi_y;
+  Column Block::*y;   // 0 for a 1D histogram.
+  HistogramWeighting weighting;
+  UInt_t cuts;        // Cut bits that must all be set.
+  bool normalize;     // Scale to unit area before saving.
+};
+
+
+template <class Block>
+HistogramSpec<Block> Hist1D(const char *key, const char *name, const char *title,
+                            int nbins, Double_t lo, Double_t hi, Column Block::*x,
+                            HistogramWeighting weighting = kUnweighted,
+                            UInt_t cuts = 0, bool normalize = true) {
+  HistogramSpec<Block> spec = {key, name, title, nbins, lo, hi, x,
+                               0, 0., 0., 0, weighting, cuts, normalize};
+  return spec;
+}
+
+
+template <class Block>
+HistogramSpec<Block> Hist2D(const char *key, const char *name, const char *title,
+                            int nbins, Double_t lo, Double_t hi, Column Block::*x,
+                            int nbins_y, Double_t lo_y, Double_t hi_y, Column Block::*y,
+                            HistogramWeighting weighting = kUnweighted,
+                            UInt_t cuts = 0, bool normalize = true) {
+  HistogramSpec<Block> spec = {key, name, title, nbins, lo, hi, x,
+                               nbins_y, lo_y, hi_y, y, weighting, cuts, normalize};
+  return spec;
+}
+
+
+// TAxis::FindBin for fixed binning, including the NaN -> overflow case.
+inline int FixedBin(Double_t v, int nbins, Double_t lo, Double_t hi) {
+  if (v < lo) return 0;
+  if (!(v < hi)) return nbins + 1;
+  return 1 + int(nbins*(v - lo)/(hi - lo));
+}
+
+
+// Cell (global bin) of event i of a spec's column(s); `in_range` is false
+// for under- and overflows, which are not counted in the statistics.
+template <class Block>
+inline int SpecCell(const HistogramSpec<Block> &s, const Double_t *x, const Double_t *y, int i,
+                    bool &in_range) {
+  int bx = FixedBin(x[i], s.nbins, s.lo, s.hi);
+  int cell = bx;
+  in_range = bx > 0 && bx <= s.nbins;
+  if (y) {
+    int by = FixedBin(y[i], s.nbins_y, s.lo_y, s.hi_y);
+    cell += by * (s.nbins + 2);
+    in_range = in_range && by > 0 && by <= s.nbins_y;
+  }
+  return cell;
+}
+
+
+// Books the TH1F/TH2F of `spec`, named spec.name + suffix.
+template <class Block>
+TH1 *BookHistogram(const HistogramSpec<Block> &spec, const std::string &suffix = "") {
+  if (spec.lo >= spec.hi || (spec.y && spec.lo_y >= spec.hi_y)) {
+    printf("Histogram %s needs a fixed axis range \n", spec.name);
+  }
+  std::string name = spec.name + suffix;
+  if (spec.y) {
+    return new TH2F(name.c_str(), spec.title.c_str(), spec.nbins, spec.lo, spec.hi,
+                    spec.nbins_y, spec.lo_y, spec.hi_y);
+  }
+  return new TH1F(name.c_str(), spec.title.c_str(), spec.nbins, spec.lo, spec.hi);
+}
+
+
+// Key suffix of the Double_t bin sums saved by HistogramSet::Write().
+const char *kHistogramBinSumSuffix = "_bin_sums";
+
+
+// What has been filled into one histogram: the Double_t bin contents of
+// everything filled or added so far, and, since the last Flush(), the sum
+// of squared weights and the TH1 statistics.
+struct HistogramAccumulator {
+  TH1 *hist = 0;
+  std::vector<Double_t> content;  // Not reset by Flush().
+  std::vector<Double_t> sumw2;
+  Double_t stats[7] = {0};
+  Double_t n_entries = 0;
+  bool weighted = false;
+  bool is_2d = false;
+
+  HistogramAccumulator(TH1 *h = 0) : hist(h) {
+    if (!h) return;
+    is_2d = h->GetDimension() > 1;
+    int ncells = (h->GetNbinsX() + 2) * (is_2d ? h->GetNbinsY() + 2 : 1);
+    content.assign(ncells, 0.);
+    sumw2.assign(ncells, 0.);
+  }
+
+  // One event of weight `wi` at (x, y) in global bin `cell`.
+  void Add(int cell, bool in_range, Double_t wi, Double_t x, Double_t y) {
+    if (wi != 1.) weighted = true;
+    n_entries += 1;
+    content[cell] += wi;
+    sumw2[cell] += wi*wi;
+    if (!in_range) return;
+
+    stats[0] += wi;
+    stats[1] += wi*wi;
+    stats[2] += wi*x;
+    stats[3] += wi*x*x;
+    if (is_2d) {
+      stats[4] += wi*y;
+      stats[5] += wi*y*y;
+      stats[6] += wi*x*y;
+    }
+  }
+
+  // Adds the accumulated statistics to the histogram and sets its bins to
+  // the bin sums.
+  void Flush() {
+    if (n_entries == 0) return;
+    TH1 *h = hist;
+
+    Double_t h_stats[TH1::kNstat] = {0};
+    h->GetStats(h_stats);
+    Double_t total_entries = h->GetEntries() + n_entries;
+
+    if (weighted && h->GetSumw2N() == 0) h->Sumw2();
+    TArrayD *h_sumw2 = h->GetSumw2N() ? h->GetSumw2() : 0;
+    for (size_t cell = 0; cell < content.size(); ++cell) {
+      h->SetBinContent(cell, content[cell]);
+      if (h_sumw2 && sumw2[cell] != 0) h_sumw2->AddAt(h_sumw2->At(cell) + sumw2[cell], cell);
+    }
+
+    for (int k = 0; k < 7; ++k) h_stats[k] += stats[k];
+    h->PutStats(h_stats);
+    h->SetEntries(total_entries);
+
+    std::fill(sumw2.begin(), sumw2.end(), 0.);
+    std::fill(stats, stats + 7, 0.);
+    n_entries = 0;
+  }
+
+  // Adds `h`, written by a job over other events, and `sums`, the bin sums
+  // saved with it (the rounded bins of `h` if there are none). Call Flush()
+  // first.
+  void Add(TH1 *h, const TVectorD *sums) {
+    bool exact = sums && sums->GetNrows() == (Int_t) content.size();
+    for (size_t cell = 0; cell < content.size(); ++cell) {
+      content[cell] += exact ? (*sums)[cell] : h->GetBinContent(cell);
+    }
+    hist->Add(h);
+    StoreContents();
+  }
+
+  // Scales the bin sums and the histogram. Call Flush() first.
+  void Scale(Double_t factor) {
+    for (Double_t &c : content) c *= factor;
+    hist->Scale(factor);
+    StoreContents();
+  }
+
+  TVectorD BinSums() const {
+    TVectorD v(content.size());
+    for (size_t cell = 0; cell < content.size(); ++cell) v[cell] = content[cell];
+    return v;
+  }
+
+ private:
+  // Sets the bins to the bin sums, keeping the statistics and entries.
+  void StoreContents() {
+    Double_t h_stats[TH1::kNstat] = {0};
+    hist->GetStats(h_stats);
+    Double_t entries = hist->GetEntries();
+    for (size_t cell = 0; cell < content.size(); ++cell) hist->SetBinContent(cell, content[cell]);
+    hist->PutStats(h_stats);
+    hist->SetEntries(entries);
+  }
+};
+
+
+template <class Block>
+class HistogramSet {
+ public:
+  HistogramSet(const std::vector<HistogramSpec<Block> > &specs,
+               Column Block::*weight = 0, CutColumn Block::*cuts = 0)
+      : weight(weight), cuts(cuts) {
+    for (const HistogramSpec<Block> &spec : specs) {
+      Entry e;
+      e.spec = spec;
+      e.acc = HistogramAccumulator(BookHistogram(spec));
+      entries.push_back(e);
+    }
+  }
+
+  // Accumulates events [0, n) of `block`. Call Flush() before reading the
+  // histograms.
+  void Fill(const Block &block, int n) {
+    const Double_t *w = weight ? block.*weight : 0;
+    const UInt_t *cut_bits = cuts ? block.*cuts : 0;
+
+    for (Entry &e : entries) {
+      const HistogramSpec<Block> &s = e.spec;
+      const Double_t *x = block.*(s.x);
+      const Double_t *y = s.y ? block.*(s.y) : 0;
+      const Double_t *ew = s.weighting == kEventWeight ? w : 0;
+
+      for (int i = 0; i < n; ++i) {
+        if (s.cuts && (!cut_bits || (cut_bits[i] & s.cuts) != s.cuts)) continue;
+        bool in_range;
+        int cell = SpecCell(s, x, y, i, in_range);
+        e.acc.Add(cell, in_range, ew ? ew[i] : 1., x[i], y ? y[i] : 0.);
+      }
+    }
+  }
+
+  // Adds everything accumulated since the last Flush() to the histograms.
+  void Flush() {
+    for (Entry &e : entries) e.acc.Flush();
+  }
+
+  // Scales every histogram flagged `normalize` to unit area.
+  void Normalize() {
+    for (Entry &e : entries) {
+      if (e.spec.normalize) e.acc.Scale(1/e.acc.hist->Integral());
+    }
+  }
+
+  // Scales every histogram, e.g. from a subsample to the whole sample.
+  // Call Flush() first.
+  void Scale(Double_t factor) {
+    for (Entry &e : entries) e.acc.Scale(factor);
+  }
+
+  // Writes the histograms with an output key, unnormalized, and their
+  // Double_t bin sums to `dir`, for Add() by another job. Call Flush()
+  // first.
+  void Write(TDirectory *dir) const {
+    for (const Entry &e : entries) {
+      if (!e.spec.key) continue;
+      dir->WriteTObject(e.acc.hist, e.spec.key, "Overwrite");
+      TVectorD sums = e.acc.BinSums();
+      dir->WriteTObject(&sums, (std::string(e.spec.key) + kHistogramBinSumSuffix).c_str(),
+                        "Overwrite");
+    }
+  }
+
+  // Adds the histograms saved under their output keys in `dir`, e.g. by
+  // Write() in a job over other events of the same sample. Call Flush()
+  // first.
+  bool Add(TDirectory *dir) {
+    for (Entry &e : entries) {
+      if (!e.spec.key) continue;
+      TH1 *h = (TH1*) dir->Get(e.spec.key);
+      if (!h) {
+        printf("No histogram %s in %s \n", e.spec.key, dir->GetPath());
+        return false;
+      }
+      TVectorD *sums = 0;
+      dir->GetObject((std::string(e.spec.key) + kHistogramBinSumSuffix).c_str(), sums);
+      e.acc.Add(h, sums);
+      delete sums;
+    }
+    return true;
+  }
+
+  TH1 *Get(const char *name) const {
+    for (const Entry &e : entries) {
+      if (strcmp(e.spec.name, name) == 0) return e.acc.hist;
+    }
+    printf("No histogram %s in set \n", name);
+    return 0;
+  }
+
+  // The histograms with an output key, for WriteSampleHistograms().
+  NamedHistograms Outputs() const {
+    NamedHistograms out;
+    for (const Entry &e : entries) {
+      if (e.spec.key) out.push_back(NamedHistogram(e.spec.key, e.acc.hist));
+    }
+    return out;
+  }
+
+  // All 2D histograms, in table order.
+  std::vector<TH1*> Histograms2D() const {
+    std::vector<TH1*> out;
+    for (const Entry &e : entries) {
+      if (e.spec.y) out.push_back(e.acc.hist);
+    }
+    return out;
+  }
+
+ private:
+  struct Entry {
+    HistogramSpec<Block> spec;
+    HistogramAccumulator acc;
+  };
+
+  Column Block::*weight;
+  CutColumn Block::*cuts;
+  std::vector<Entry> entries;
+};
+
+#endif
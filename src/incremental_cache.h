@@ -0,0 +1,181 @@
+// Incremental reprocessing: per-input-file results cached so that running a
+// sample again only processes the files that are new or have changed.
+//
+// Each job (e.g. the skim of one sample) keeps an index
+//
+//   <cache_dir>/<job>.index
+//
+// with one line per input file: its path, its identity (size, modification
+// time and entry count), the selection key it was processed with, and named
+// per-file results as "key=value" (accepted events, sum of weights, ...).
+// The outputs of a file live next to the index, at IncrementalPartPath().
+// A file is processed again when its identity or the selection key differs
+// from its index line, or when its output is missing; otherwise the cached
+// results are used. Files that are no longer part of the sample are
+// dropped from the index and their outputs removed.
+//
+// The entry count of an identity is the one the job reads the file with,
+// e.g. cached in the sample registry. A file whose size or modification
+// time changed since it was indexed (ModifiedSinceIndexed()) may have been
+// rewritten in place, so the job counts its entries again rather than
+// trust that count.
+//
+// Nothing cached may depend on the other files of the sample: a result that
+// does (the Cutflow.C reweight, through the entry count of the whole
+// sample) is stored without that factor and completed at the merge.
+//
+// The index is written after every processed file, through a ".tmp" file
+// and a rename (shard.h), so a killed run keeps what it had finished.
+
+#ifndef INCREMENTAL_CACHE_H
+#define INCREMENTAL_CACHE_H
+
+#include <TSystem.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include "shard.h"
+
+
+// What identifies the contents of an input file. A file that cannot be
+// stat'ed (e.g. a remote URL) has size -1 and is never taken from the cache.
+struct InputFileIdentity {
+  Long64_t size = -1;
+  Long_t mtime = 0;
+  Long64_t entries = 0;
+
+  bool Known() const { return size >= 0; }
+
+  bool operator==(const InputFileIdentity &other) const {
+    return size == other.size && mtime == other.mtime && entries == other.entries;
+  }
+
+  // Same size and modification time, whatever the entry counts.
+  bool SameFile(const InputFileIdentity &other) const {
+    return Known() && size == other.size && mtime == other.mtime;
+  }
+};
+
+
+InputFileIdentity GetInputFileIdentity(const std::string &path, Long64_t entries) {
+  InputFileIdentity id;
+  id.entries = entries;
+  FileStat_t stat;
+  if (gSystem->GetPathInfo(path.c_str(), stat) == 0) {
+    id.size = stat.fSize;
+    id.mtime = stat.fMtime;
+  }
+  return id;
+}
+
+
+struct IncrementalEntry {
+  InputFileIdentity id;
+  std::string selection;
+  std::map<std::string, Double_t> results;
+};
+
+
+// Index entries by input file path.
+typedef std::map<std::string, IncrementalEntry> IncrementalIndex;
+
+
+std::string IncrementalIndexPath(const char *cache_dir, const std::string &job) {
+  return std::string(cache_dir) + "/" + job + ".index";
+}
+
+
+// <cache_dir>/<job>.<hash of input_path><suffix>. The hash (64-bit FNV-1a)
+// does not change between sessions or platforms.
+std::string IncrementalPartPath(const char *cache_dir, const std::string &job,
+                                const std::string &input_path, const char *suffix) {
+  ULong64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : input_path) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  char name[32];
+  snprintf(name, sizeof(name), ".%016llx", hash);
+  return std::string(cache_dir) + "/" + job + name + suffix;
+}
+
+
+// An index that does not exist yet is empty. Lines that cannot be parsed
+// are reported and skipped; their files are processed again.
+IncrementalIndex LoadIncrementalIndex(const std::string &path) {
+  IncrementalIndex index;
+  std::ifstream in(path.c_str());
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    std::istringstream tokens(line);
+    std::string input_path;
+    IncrementalEntry entry;
+    if (!(tokens >> input_path)) continue;
+    if (!(tokens >> entry.id.size >> entry.id.mtime >> entry.id.entries >> entry.selection)) {
+      printf("%s:%d: cannot parse index line \n", path.c_str(), line_number);
+      continue;
+    }
+    std::string result;
+    while (tokens >> result) {
+      size_t eq = result.find('=');
+      if (eq == std::string::npos) continue;
+      entry.results[result.substr(0, eq)] = atof(result.c_str() + eq + 1);
+    }
+    index[input_path] = entry;
+  }
+  return index;
+}
+
+
+bool SaveIncrementalIndex(const std::string &path, const IncrementalIndex &index) {
+  std::string tmp_path = path + ".tmp";
+  FILE *out = fopen(tmp_path.c_str(), "w");
+  if (!out) {
+    printf("Cannot write %s \n", tmp_path.c_str());
+    return false;
+  }
+  for (const auto &file : index) {
+    const IncrementalEntry &entry = file.second;
+    fprintf(out, "%s %lld %ld %lld %s", file.first.c_str(), entry.id.size, entry.id.mtime,
+            entry.id.entries, entry.selection.c_str());
+    for (const auto &result : entry.results) {
+      fprintf(out, " %s=%.17g", result.first.c_str(), result.second);
+    }
+    fprintf(out, "\n");
+  }
+  if (fclose(out) != 0) {
+    printf("Cannot write %s \n", tmp_path.c_str());
+    return false;
+  }
+  return CommitShardFile(tmp_path, path);
+}
+
+
+// True unless `input_path` has an index line with the same size and
+// modification time as `id`: a new file, or one that may have been
+// rewritten in place since it was indexed.
+bool ModifiedSinceIndexed(const IncrementalIndex &index, const std::string &input_path,
+                          const InputFileIdentity &id) {
+  IncrementalIndex::const_iterator it = index.find(input_path);
+  return it == index.end() || !it->second.id.SameFile(id);
+}
+
+
+// True if `input_path` can be taken from the cache: it has an index line
+// for the same identity and selection, and its output `part_path` exists.
+bool IsIncrementalCurrent(const IncrementalIndex &index, const std::string &input_path,
+                          const InputFileIdentity &id, const std::string &selection,
+                          const std::string &part_path) {
+  IncrementalIndex::const_iterator it = index.find(input_path);
+  if (it == index.end() || !id.Known()) return false;
+  if (!(it->second.id == id) || it->second.selection != selection) return false;
+  return !gSystem->AccessPathName(part_path.c_str());
+}
+
+#endif
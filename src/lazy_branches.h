@@ -0,0 +1,222 @@
+// Reading Delphes branches on demand, and selections whose cuts load only
+// the branches they need.
+//
+// ExRootTreeReader::ReadEntry() reads every used branch of every entry,
+// although most events of a background sample are rejected by a cut that
+// looks at one branch (e.g. MET < 30 GeV needs only MissingET).
+// LazyBranchReader keeps the same TClonesArray per branch, but SetEntry()
+// only moves to an entry; a branch is read when Load() asks for it, at most
+// once per entry:
+//
+//   LazyBranchReader reader(chain);
+//   int b_met = reader.UseBranch("MissingET");
+//   for (...) {
+//     reader.SetEntry(entry);
+//     MissingET *met = (MissingET*) reader.Load(b_met)->At(0);
+//   }
+//
+// A LazySelection is a list of cuts, each naming the branches it needs.
+// Run() loads them just before a cut is tested and stops at the first
+// failure. Cuts must be independent of each other's results (their order
+// must not change which events pass), so they can be reordered: over the
+// first `calibration_events` events every cut is tested and timed, loading
+// included, on every event, and afterwards the cuts run in decreasing
+// order of rejected fraction per second of cost. A branch shared by
+// several cuts is charged to the first one that loads it. With a monitor
+// set (SetMonitor()), the cuts counted during those events go to its
+// calibration counters, so its cut summary stays that of the ordered run.
+//
+// Bytes read per branch (uncompressed, and compressed estimated from the
+// branch's compression factor in the current file) can be sent to a
+// LoopMonitor set up with CountBranches(reader.BranchNames()).
+
+#ifndef LAZY_BRANCHES_H
+#define LAZY_BRANCHES_H
+
+#include <TBranchElement.h>
+#include <TChain.h>
+#include <TClonesArray.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "loop_monitor.h"
+
+
+class LazyBranchReader {
+ public:
+  LazyBranchReader(TChain *chain) : chain(chain) {}
+
+  ~LazyBranchReader() {
+    for (TClonesArray *array : arrays) delete array;
+  }
+
+  // Declares the TClonesArray branch `name` and returns its index for
+  // Load(), or -1 if the chain has no such branch.
+  int UseBranch(const char *name) {
+    TBranchElement *element = dynamic_cast<TBranchElement*>(chain->GetBranch(name));
+    if (!element) {
+      printf("No branch %s \n", name);
+      return -1;
+    }
+    names.push_back(name);
+    arrays.push_back(new TClonesArray(element->GetClonesName(), element->GetMaximum()));
+    arrays.back()->SetName(name);
+    branches.push_back(0);
+    zip_ratio.push_back(1.);
+    loaded.push_back(false);
+    tree_number = -1;
+    return arrays.size() - 1;
+  }
+
+  TClonesArray *Array(int b) const { return arrays[b]; }
+
+  Long64_t GetEntries() const { return chain->GetEntries(); }
+
+  // Moves to `entry` without reading anything.
+  bool SetEntry(Long64_t entry) {
+    local_entry = chain->LoadTree(entry);
+    if (local_entry < 0) return false;
+    if (chain->GetTreeNumber() != tree_number) NextTree();
+    std::fill(loaded.begin(), loaded.end(), false);
+    return true;
+  }
+
+  // Reads branch `b` of the current entry, unless it was read already.
+  TClonesArray *Load(int b) {
+    if (!loaded[b]) {
+      loaded[b] = true;
+      Int_t bytes = branches[b] ? branches[b]->GetEntry(local_entry) : 0;
+      if (monitor && bytes > 0) monitor->AddBranchBytes(b, bytes, (Long64_t) (bytes * zip_ratio[b]));
+    }
+    return arrays[b];
+  }
+
+  // Reads every declared branch, as ExRootTreeReader::ReadEntry() does.
+  void LoadAll() {
+    for (size_t b = 0; b < arrays.size(); ++b) Load(b);
+  }
+
+  const std::vector<std::string> &BranchNames() const { return names; }
+
+  void SetMonitor(LoopMonitor *m) { monitor = m; }
+
+ private:
+  // The chain moved to another file: the TBranch objects are new.
+  void NextTree() {
+    tree_number = chain->GetTreeNumber();
+    for (size_t b = 0; b < arrays.size(); ++b) {
+      branches[b] = chain->GetBranch(names[b].c_str());
+      if (!branches[b]) continue;
+      branches[b]->SetAddress(&arrays[b]);
+      Long64_t tot = branches[b]->GetTotBytes("*");
+      zip_ratio[b] = tot > 0 ? (Double_t) branches[b]->GetZipBytes("*") / tot : 1.;
+    }
+  }
+
+  TChain *chain;
+  LoopMonitor *monitor = 0;
+  Long64_t local_entry = -1;
+  Int_t tree_number = -1;
+  std::vector<std::string> names;
+  std::vector<TClonesArray*> arrays;
+  std::vector<TBranch*> branches;
+  std::vector<Double_t> zip_ratio;
+  std::vector<bool> loaded;
+};
+
+
+class LazySelection {
+ public:
+  // With calibration_events = 0 the cuts always run in the order they were
+  // added.
+  LazySelection(LazyBranchReader &reader, Long64_t calibration_events = 0,
+                const char *tag = "")
+      : reader(reader), calibration_events(calibration_events), tag(tag) {}
+
+  // Adds a cut that reads `branches` (indices from UseBranch()) and then
+  // calls `test`.
+  void Add(const char *name, const std::vector<int> &branches, std::function<bool()> test) {
+    Cut cut;
+    cut.name = name;
+    cut.branches = branches;
+    cut.test = test;
+    cuts.push_back(cut);
+    order.push_back(cuts.size() - 1);
+  }
+
+  // Tests the cuts on the current entry of the reader; true if all pass.
+  bool Run() {
+    if (monitor) monitor->SetCalibrating(events < calibration_events);
+    if (events < calibration_events) return Calibrate();
+    for (int c : order) {
+      Cut &cut = cuts[c];
+      for (int b : cut.branches) reader.Load(b);
+      if (!cut.test()) return false;
+    }
+    return true;
+  }
+
+  // Cut indices in the order they are run.
+  const std::vector<int> &Order() const { return order; }
+
+  // Marks the calibration events in `m` (LoopMonitor::SetCalibrating()).
+  void SetMonitor(LoopMonitor *m) { monitor = m; }
+
+ private:
+  struct Cut {
+    std::string name;
+    std::vector<int> branches;
+    std::function<bool()> test;
+    Long64_t tested = 0, passed = 0;
+    Double_t seconds = 0;
+  };
+
+  bool Calibrate() {
+    bool pass = true;
+    for (int c : order) {
+      Cut &cut = cuts[c];
+      LoopClock::time_point start = LoopClock::now();
+      for (int b : cut.branches) reader.Load(b);
+      bool cut_pass = cut.test();
+      cut.seconds += std::chrono::duration<Double_t>(LoopClock::now() - start).count();
+      cut.tested++;
+      if (cut_pass) cut.passed++;
+      pass = pass && cut_pass;
+    }
+    if (++events == calibration_events) Reorder();
+    return pass;
+  }
+
+  // Sorts the cuts by rejected fraction per second, highest first.
+  void Reorder() {
+    std::vector<Double_t> rank(cuts.size());
+    for (size_t c = 0; c < cuts.size(); ++c) {
+      Double_t rejected = 1. - (Double_t) cuts[c].passed / cuts[c].tested;
+      Double_t cost = cuts[c].seconds / cuts[c].tested;
+      rank[c] = rejected / std::max(cost, 1e-12);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return rank[a] > rank[b]; });
+
+    printf("%sCut order after %lld events:", tag.c_str(), events);
+    for (size_t k = 0; k < order.size(); ++k) {
+      const Cut &cut = cuts[order[k]];
+      printf(" %s (rejects %.1f%%, %.2f us)%s", cut.name.c_str(),
+             100. * (1. - (Double_t) cut.passed / cut.tested), 1e6 * cut.seconds / cut.tested,
+             k + 1 < order.size() ? "," : "");
+    }
+    printf(" \n");
+  }
+
+  LazyBranchReader &reader;
+  LoopMonitor *monitor = 0;
+  Long64_t calibration_events;
+  Long64_t events = 0;
+  std::string tag;
+  std::vector<Cut> cuts;
+  std::vector<int> order;
+};
+
+#endif
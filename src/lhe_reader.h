@@ -0,0 +1,291 @@
+// Streaming reader for Les Houches event files (.lhe or .lhe.gz).
+//
+// LHEReader reads the raw file in chunks of a few tens of MB (zlib reads
+// plain and gzipped files alike), cuts each chunk after its last complete
+// </event>, and decodes the <event> blocks into LHEEvents: flat arrays of
+// particle columns with per-event offsets, reused from chunk to chunk, so
+// there is no per-particle object and no ExRootLHEFConverter step. With
+// n_threads > 1 each chunk is split at <event> boundaries and the pieces
+// are decoded concurrently, then joined in file order.
+//
+// Particle kinematics follow TRootLHEFParticle: PT, Eta (+-999.9 for
+// pT = 0) and Phi from (Px, Py, Pz, E), M from the fifth PUP entry. Events
+// copied from an ExRootLHEFConverter tree can carry the stored PT, Eta and
+// Phi instead (the pt, eta and phi columns), so that they read exactly as
+// from the tree.
+//
+// USAGE:
+//   LHEReader reader("events.lhe.gz", 4);
+//   LHEEvents events;
+//   while (reader.Next(events)) {
+//     for (Long64_t i = 0; i < events.size(); ++i) { ... }
+//   }
+
+#ifndef LHE_READER_H
+#define LHE_READER_H
+
+#include <Rtypes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+
+// Events decoded from an LHE file; particle k of event i for k in
+// [begin[i], begin[i + 1]).
+struct LHEEvents {
+  std::vector<Double_t> weight;  // XWGTUP.
+  std::vector<Long64_t> begin;
+  std::vector<Int_t> pid, status, mother1, mother2;
+  std::vector<Double_t> px, py, pz, e, m;
+  std::vector<Double_t> pt, eta, phi;  // Stored values, if any; empty from LHEReader.
+
+  void clear() {
+    weight.clear();
+    begin.assign(1, 0);
+    pid.clear();
+    status.clear();
+    mother1.clear();
+    mother2.clear();
+    px.clear();
+    py.clear();
+    pz.clear();
+    e.clear();
+    m.clear();
+    pt.clear();
+    eta.clear();
+    phi.clear();
+  }
+
+  Long64_t size() const { return weight.size(); }
+
+  Double_t PT(Long64_t k) const {
+    if (!pt.empty()) return pt[k];
+    return std::hypot(px[k], py[k]);
+  }
+  Double_t Eta(Long64_t k) const {
+    if (!eta.empty()) return eta[k];
+    Double_t p_t = PT(k);
+    if (p_t == 0) return pz[k] >= 0 ? 999.9 : -999.9;
+    return std::asinh(pz[k] / p_t);
+  }
+  Double_t Phi(Long64_t k) const {
+    if (!phi.empty()) return phi[k];
+    return (px[k] == 0 && py[k] == 0) ? 0. : std::atan2(py[k], px[k]);
+  }
+
+  // Appends the events of `o`.
+  void Append(const LHEEvents &o) {
+    if (begin.empty()) begin.push_back(0);
+    Long64_t offset = pid.size();
+    weight.insert(weight.end(), o.weight.begin(), o.weight.end());
+    for (size_t i = 1; i < o.begin.size(); ++i) begin.push_back(o.begin[i] + offset);
+    pid.insert(pid.end(), o.pid.begin(), o.pid.end());
+    status.insert(status.end(), o.status.begin(), o.status.end());
+    mother1.insert(mother1.end(), o.mother1.begin(), o.mother1.end());
+    mother2.insert(mother2.end(), o.mother2.begin(), o.mother2.end());
+    px.insert(px.end(), o.px.begin(), o.px.end());
+    py.insert(py.end(), o.py.begin(), o.py.end());
+    pz.insert(pz.end(), o.pz.begin(), o.pz.end());
+    e.insert(e.end(), o.e.begin(), o.e.end());
+    m.insert(m.end(), o.m.begin(), o.m.end());
+    pt.insert(pt.end(), o.pt.begin(), o.pt.end());
+    eta.insert(eta.end(), o.eta.begin(), o.eta.end());
+    phi.insert(phi.end(), o.phi.begin(), o.phi.end());
+  }
+};
+
+
+namespace lhe_detail {
+
+// First "<event" tag (followed by '>' or a blank) in [p, end), or end.
+inline const char *FindEventTag(const char *p, const char *end) {
+  static const char kTag[] = "<event";
+  const size_t n = sizeof(kTag) - 1;
+  while (end - p > (long) n) {
+    p = (const char*) memchr(p, '<', end - p);
+    if (!p || end - p <= (long) n) return end;
+    if (memcmp(p, kTag, n) == 0 && (p[n] == '>' || p[n] == ' ' || p[n] == '\t')) return p;
+    ++p;
+  }
+  return end;
+}
+
+
+// Start of the line after `p`.
+inline const char *NextLine(const char *p, const char *end) {
+  const char *nl = (const char*) memchr(p, '\n', end - p);
+  return nl ? nl + 1 : end;
+}
+
+
+// Decodes the event block starting at the "<event" tag `p`; returns the
+// position after it, or 0 if the block is malformed.
+const char *ParseEvent(const char *p, const char *end, LHEEvents &out) {
+  p = NextLine(p, end);
+  char *q;
+  long n = strtol(p, &q, 10);
+  if (q == p || n < 0) return 0;
+  strtol(q, &q, 10);                // IDPRUP
+  Double_t weight = strtod(q, &q);  // XWGTUP
+  p = NextLine(q, end);
+
+  for (long k = 0; k < n; ++k) {
+    if (p >= end) return 0;
+    Int_t id = strtol(p, &q, 10);
+    if (q == p) return 0;
+    out.pid.push_back(id);
+    out.status.push_back(strtol(q, &q, 10));
+    out.mother1.push_back(strtol(q, &q, 10));
+    out.mother2.push_back(strtol(q, &q, 10));
+    strtol(q, &q, 10);  // ICOLUP
+    strtol(q, &q, 10);
+    out.px.push_back(strtod(q, &q));
+    out.py.push_back(strtod(q, &q));
+    out.pz.push_back(strtod(q, &q));
+    out.e.push_back(strtod(q, &q));
+    out.m.push_back(strtod(q, &q));
+    p = NextLine(q, end);
+  }
+  out.weight.push_back(weight);
+  out.begin.push_back(out.pid.size());
+
+  const char *close = strstr(p, "</event>");
+  return close && close < end ? close + 8 : end;
+}
+
+
+// Decodes every event block that starts in [p, end). Returns the number of
+// malformed blocks skipped.
+int ParseEvents(const char *p, const char *end, LHEEvents &out) {
+  int bad = 0;
+  for (p = FindEventTag(p, end); p < end; p = FindEventTag(p, end)) {
+    size_t n_before = out.pid.size();
+    const char *next = ParseEvent(p, end, out);
+    if (!next) {
+      // Drop the partial particles of the bad block.
+      out.pid.resize(n_before);
+      out.status.resize(n_before);
+      out.mother1.resize(n_before);
+      out.mother2.resize(n_before);
+      out.px.resize(n_before);
+      out.py.resize(n_before);
+      out.pz.resize(n_before);
+      out.e.resize(n_before);
+      out.m.resize(n_before);
+      bad++;
+      next = p + 1;
+    }
+    p = next;
+  }
+  return bad;
+}
+
+}  // namespace lhe_detail
+
+
+class LHEReader {
+ public:
+  LHEReader(const char *path, int n_threads = 1, size_t chunk_bytes = 64 << 20)
+      : path(path), n_threads(n_threads < 1 ? 1 : n_threads), chunk_bytes(chunk_bytes) {
+    file = gzopen(path, "rb");
+    if (!file) {
+      printf("Cannot open %s \n", path);
+      return;
+    }
+    gzbuffer(file, 1 << 20);
+  }
+
+  ~LHEReader() {
+    if (file) gzclose(file);
+  }
+
+  bool IsOpen() const { return file != 0; }
+
+  // Replaces `events` with the events of the next chunk of the file.
+  // Returns false once the file is exhausted.
+  bool Next(LHEEvents &events) {
+    events.clear();
+    if (!file) return false;
+
+    // Read until the buffer holds at least one complete event.
+    size_t cut = std::string::npos;
+    while (true) {
+      if (!at_eof) Fill();
+      cut = buffer.rfind("</event>");
+      if (cut != std::string::npos || at_eof) break;
+    }
+    if (cut == std::string::npos) {
+      buffer.clear();
+      return false;
+    }
+    cut += 8;
+
+    const char *begin = buffer.data();
+    const char *end = begin + cut;
+    int bad = 0;
+    if (n_threads == 1) {
+      bad = lhe_detail::ParseEvents(begin, end, events);
+    } else {
+      // Split at event tags and decode the pieces concurrently.
+      std::vector<const char*> bounds(n_threads + 1, end);
+      bounds[0] = begin;
+      for (int t = 1; t < n_threads; ++t) {
+        const char *guess = begin + (end - begin) * t / n_threads;
+        bounds[t] = lhe_detail::FindEventTag(std::max(guess, bounds[t - 1]), end);
+      }
+      parts.resize(n_threads);
+      std::vector<int> part_bad(n_threads, 0);
+      std::vector<std::thread> workers;
+      for (int t = 0; t < n_threads; ++t) {
+        parts[t].clear();
+        workers.emplace_back([&, t]() {
+          part_bad[t] = lhe_detail::ParseEvents(bounds[t], bounds[t + 1], parts[t]);
+        });
+      }
+      for (auto &worker : workers) worker.join();
+      for (int t = 0; t < n_threads; ++t) {
+        events.Append(parts[t]);
+        bad += part_bad[t];
+      }
+    }
+    if (bad > 0) printf("%s: skipped %d malformed event blocks \n", path.c_str(), bad);
+
+    buffer.erase(0, cut);
+    events_read += events.size();
+    return true;
+  }
+
+  Long64_t EventsRead() const { return events_read; }
+
+ private:
+  void Fill() {
+    size_t old_size = buffer.size();
+    buffer.resize(old_size + chunk_bytes);
+    int n = gzread(file, &buffer[old_size], chunk_bytes);
+    if (n <= 0) {
+      if (n < 0) printf("Read error in %s \n", path.c_str());
+      at_eof = true;
+      n = 0;
+    }
+    buffer.resize(old_size + n);
+  }
+
+  std::string path;
+  int n_threads;
+  size_t chunk_bytes;
+  gzFile file = 0;
+  bool at_eof = false;
+  std::string buffer;
+  std::vector<LHEEvents> parts;
+  Long64_t events_read = 0;
+};
+
+#endif
@@ -0,0 +1,293 @@
+// Binned CLs upper limits on a signal strength, from toy ensembles run on a
+// pool of threads.
+//
+// A LimitModel is one mass point: the expected signal and background
+// counts per bin, and optionally the observed counts. Its limit is on the
+// signal strength mu, the multiple of `signal` that is excluded at
+// confidence level `cl`. The test statistic is the LEP one,
+//
+//   Q(n; mu) = -ln L(mu) / L(0) = sum_i [mu s_i - n_i ln(1 + mu s_i / b_i)]
+//
+// (large Q is background-like), with no nuisance parameters, so a toy costs
+// one Poisson draw and one multiply-add per bin. Bins with no background
+// are left out. For each mu of a log-spaced grid around the Asimov
+// sensitivity, background-only and signal-plus-background toys give
+//
+//   CLs(mu) = P(Q >= Q_obs | mu s + b) / P(Q >= Q_obs | b)
+//
+// and the limit is where CLs crosses 1 - cl, interpolated linearly between
+// grid points. The expected limits and their +-1 sigma, +-2 sigma bands
+// use, in place of Q_obs, the quantiles of Q in the background-only toys.
+//
+// Toys are split into tasks of `toys_per_task` per (model, mu); workers
+// take the next task from a shared counter. Each task draws from its own
+// generator, seeded from (seed, model, mu, task), so the limits do not
+// depend on the number of threads or on which thread ran what.
+
+#ifndef LIMITS_H
+#define LIMITS_H
+
+#include <Rtypes.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct LimitModel {
+  std::string name;
+  Double_t mass = 0;
+  std::vector<Double_t> signal;      // Expected counts per bin at mu = 1.
+  std::vector<Double_t> background;  // Expected counts per bin.
+  std::vector<Double_t> observed;    // Counts per bin; empty for no observed limit.
+};
+
+
+struct LimitSettings {
+  int n_toys = 10000;         // Per hypothesis and mu.
+  int toys_per_task = 1000;
+  int n_mu = 40;              // Grid points.
+  Double_t mu_range = 20.;    // The grid spans [mu0 / range, mu0 * range].
+  Double_t cl = 0.95;
+  ULong64_t seed = 1;
+};
+
+
+// Observed limit and expected limits at -2, -1, 0, +1, +2 sigma. NaN where
+// the CLs curve does not cross 1 - cl on the grid.
+struct LimitResult {
+  std::string name;
+  Double_t mass = 0;
+  Double_t observed = 0;
+  Double_t expected[5] = {0};
+  Double_t signal_yield = 0;
+  Double_t background_yield = 0;
+};
+
+
+namespace limits_detail {
+
+// One model with its empty-background bins removed.
+struct Channel {
+  std::vector<Double_t> s, b, n_obs;
+  Double_t s_tot = 0, b_tot = 0;
+  std::vector<Double_t> mu;  // Grid.
+};
+
+
+Channel MakeChannel(const LimitModel &model, const LimitSettings &settings) {
+  Channel c;
+  bool use_observed = !model.observed.empty();
+  if (model.signal.size() != model.background.size() ||
+      (use_observed && model.observed.size() != model.background.size())) {
+    printf("%s: signal, background and observed have different numbers of bins \n",
+           model.name.c_str());
+    use_observed = use_observed && model.observed.size() == model.background.size();
+  }
+  for (size_t i = 0; i < model.background.size() && i < model.signal.size(); ++i) {
+    if (model.background[i] <= 0 || model.signal[i] < 0) continue;
+    c.s.push_back(model.signal[i]);
+    c.b.push_back(model.background[i]);
+    if (use_observed) c.n_obs.push_back(model.observed[i]);
+    c.s_tot += model.signal[i];
+    c.b_tot += model.background[i];
+  }
+
+  // Around the mu of a two sigma excess in a single counting bin.
+  Double_t mu0 = c.s_tot > 0 ? 2 * sqrt(std::max(c.b_tot, 1.)) / c.s_tot : 1.;
+  for (int k = 0; k < settings.n_mu; ++k) {
+    Double_t x = settings.n_mu > 1 ? (Double_t) k / (settings.n_mu - 1) : 0.5;
+    c.mu.push_back(mu0 * pow(settings.mu_range, 2 * x - 1));
+  }
+  return c;
+}
+
+
+// Q(n; mu) with weights w_i = ln(1 + mu s_i / b_i).
+Double_t TestStatistic(const std::vector<Double_t> &n, const std::vector<Double_t> &w,
+                       Double_t mu_s_tot) {
+  Double_t q = mu_s_tot;
+  for (size_t i = 0; i < n.size(); ++i) q -= n[i] * w[i];
+  return q;
+}
+
+
+// Fraction of the sorted `q` at or above `q_obs`.
+Double_t TailFraction(const std::vector<Double_t> &q, Double_t q_obs) {
+  return (Double_t) (q.end() - std::lower_bound(q.begin(), q.end(), q_obs)) / q.size();
+}
+
+
+// First crossing of `cls` below `alpha` along `mu`.
+Double_t Crossing(const std::vector<Double_t> &mu, const std::vector<Double_t> &cls,
+                  Double_t alpha) {
+  for (size_t k = 1; k < mu.size(); ++k) {
+    if (cls[k - 1] >= alpha && cls[k] < alpha) {
+      return mu[k - 1] + (mu[k] - mu[k - 1]) * (cls[k - 1] - alpha) / (cls[k - 1] - cls[k]);
+    }
+  }
+  return std::numeric_limits<Double_t>::quiet_NaN();
+}
+
+}  // namespace limits_detail
+
+
+bool CheckLimitSettings(const LimitSettings &settings) {
+  if (settings.n_toys < 1 || settings.toys_per_task < 1 || settings.n_mu < 1) {
+    printf("Invalid limit settings: %d toys, %d toys per task, %d mu points \n",
+           settings.n_toys, settings.toys_per_task, settings.n_mu);
+    return false;
+  }
+  if (!(settings.mu_range >= 1) || !(settings.cl > 0 && settings.cl < 1)) {
+    printf("Invalid limit settings: mu range %g (at least 1), cl %g (in (0, 1)) \n",
+           settings.mu_range, settings.cl);
+    return false;
+  }
+  return true;
+}
+
+
+// Returns no results if the settings are invalid.
+std::vector<LimitResult> RunCLsLimits(const std::vector<LimitModel> &models,
+                                      const LimitSettings &settings, int n_threads = 1) {
+  using namespace limits_detail;
+  if (!CheckLimitSettings(settings)) return std::vector<LimitResult>();
+  int n_mu = settings.n_mu;
+  int n_tasks_per_mu = (settings.n_toys + settings.toys_per_task - 1) / settings.toys_per_task;
+
+  std::vector<Channel> channels;
+  for (const LimitModel &model : models) channels.push_back(MakeChannel(model, settings));
+
+  // q_b[m][k] and q_sb[m][k]: Q of the toys of model m at mu index k.
+  std::vector<std::vector<std::vector<Double_t> > > q_b(models.size()), q_sb(models.size());
+  for (size_t m = 0; m < models.size(); ++m) {
+    q_b[m].assign(n_mu, std::vector<Double_t>(settings.n_toys));
+    q_sb[m].assign(n_mu, std::vector<Double_t>(settings.n_toys));
+  }
+
+  size_t n_tasks = models.size() * n_mu * n_tasks_per_mu;
+  auto run_task = [&](size_t t) {
+    int chunk = t % n_tasks_per_mu;
+    int k = (t / n_tasks_per_mu) % n_mu;
+    int m = t / n_tasks_per_mu / n_mu;
+    const Channel &c = channels[m];
+    Double_t mu = c.mu[k];
+
+    std::seed_seq seq{(UInt_t) settings.seed, (UInt_t) (settings.seed >> 32), (UInt_t) m,
+                      (UInt_t) k, (UInt_t) chunk};
+    std::mt19937_64 rng(seq);
+    size_t n_bins = c.b.size();
+    std::vector<Double_t> w(n_bins), n(n_bins);
+    std::vector<std::poisson_distribution<Long64_t> > pois_b, pois_sb;
+    for (size_t i = 0; i < n_bins; ++i) {
+      w[i] = log(1 + mu * c.s[i] / c.b[i]);
+      pois_b.push_back(std::poisson_distribution<Long64_t>(c.b[i]));
+      pois_sb.push_back(std::poisson_distribution<Long64_t>(mu * c.s[i] + c.b[i]));
+    }
+
+    int first = chunk * settings.toys_per_task;
+    int last = std::min(settings.n_toys, first + settings.toys_per_task);
+    for (int toy = first; toy < last; ++toy) {
+      for (size_t i = 0; i < n_bins; ++i) n[i] = pois_b[i](rng);
+      q_b[m][k][toy] = TestStatistic(n, w, mu * c.s_tot);
+      for (size_t i = 0; i < n_bins; ++i) n[i] = pois_sb[i](rng);
+      q_sb[m][k][toy] = TestStatistic(n, w, mu * c.s_tot);
+    }
+  };
+
+  if (n_threads > (int) n_tasks) n_threads = n_tasks;
+  if (n_threads <= 1) {
+    for (size_t t = 0; t < n_tasks; ++t) run_task(t);
+  } else {
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < n_threads; ++w) {
+      workers.emplace_back([&]() {
+        for (size_t t = next++; t < n_tasks; t = next++) run_task(t);
+      });
+    }
+    for (auto &worker : workers) worker.join();
+  }
+
+  // Expected limits at -2..+2 sigma come from the Q quantiles 1 - Phi(k):
+  // a background-like (high Q) outcome gives a low limit.
+  const Double_t kBandQuantile[5] = {0.97725, 0.84134, 0.5, 0.15866, 0.02275};
+  Double_t alpha = 1 - settings.cl;
+  std::vector<LimitResult> results;
+  for (size_t m = 0; m < models.size(); ++m) {
+    const Channel &c = channels[m];
+    std::vector<Double_t> cls_obs(n_mu), cls_exp[5];
+    for (int k = 0; k < n_mu; ++k) {
+      std::vector<Double_t> &b = q_b[m][k];
+      std::vector<Double_t> &sb = q_sb[m][k];
+      std::sort(b.begin(), b.end());
+      std::sort(sb.begin(), sb.end());
+
+      auto cls = [&](Double_t q) {
+        Double_t cl_b = TailFraction(b, q);
+        return cl_b > 0 ? TailFraction(sb, q) / cl_b : 0.;
+      };
+      if (!c.n_obs.empty()) {
+        std::vector<Double_t> w(c.b.size());
+        for (size_t i = 0; i < w.size(); ++i) w[i] = log(1 + c.mu[k] * c.s[i] / c.b[i]);
+        cls_obs[k] = cls(TestStatistic(c.n_obs, w, c.mu[k] * c.s_tot));
+      }
+      for (int band = 0; band < 5; ++band) {
+        size_t index = (size_t) (kBandQuantile[band] * (b.size() - 1));
+        cls_exp[band].push_back(cls(b[index]));
+      }
+    }
+
+    LimitResult r;
+    r.name = models[m].name;
+    r.mass = models[m].mass;
+    r.signal_yield = c.s_tot;
+    r.background_yield = c.b_tot;
+    r.observed = c.n_obs.empty() ? std::numeric_limits<Double_t>::quiet_NaN()
+                                 : Crossing(c.mu, cls_obs, alpha);
+    for (int band = 0; band < 5; ++band) r.expected[band] = Crossing(c.mu, cls_exp[band], alpha);
+    if (std::isnan(r.expected[2])) {
+      printf("%s: the expected CLs does not cross %g on mu in [%g, %g] \n", r.name.c_str(),
+             alpha, c.mu.front(), c.mu.back());
+    }
+    results.push_back(r);
+  }
+  return results;
+}
+
+
+void PrintLimits(const std::vector<LimitResult> &results) {
+  for (const LimitResult &r : results) {
+    printf("%s: observed %g, expected %g [%g, %g] (1 sigma) [%g, %g] (2 sigma) \n",
+           r.name.c_str(), r.observed, r.expected[2], r.expected[1], r.expected[3],
+           r.expected[0], r.expected[4]);
+  }
+}
+
+
+// One tab-separated line per mass point; limits are on mu.
+bool WriteLimitTable(const std::vector<LimitResult> &results, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  fprintf(out, "name\tmass\tsignal\tbackground\tobserved\texpected_m2\texpected_m1\t"
+               "expected\texpected_p1\texpected_p2\n");
+  for (const LimitResult &r : results) {
+    fprintf(out, "%s\t%g\t%g\t%g\t%g", r.name.c_str(), r.mass, r.signal_yield,
+            r.background_yield, r.observed);
+    for (int band = 0; band < 5; ++band) fprintf(out, "\t%g", r.expected[band]);
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  return true;
+}
+
+#endif
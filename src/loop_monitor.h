@@ -0,0 +1,350 @@
+// Throughput and hot-path counters for event loops.
+//
+// A LoopMonitor takes the place of the "On event ..." printfs. Event() is
+// called once per entry (or once per block of entries) and prints a report
+// at most every `report_seconds` of wall time:
+//   - events/s over the whole loop and since the previous report;
+//   - the fraction of wall time spent in each named stage ("other" is
+//     whatever was not inside a stage);
+//   - the bytes read so far from each watched branch, uncompressed and
+//     compressed;
+//   - the fraction of events rejected by each counted cut.
+// Cuts counted while SetCalibrating(true) is in effect (a LazySelection
+// timing its cuts, see lazy_branches.h, tests every cut of an event rather
+// than stopping at the first failure) are kept and reported apart.
+// Summary() prints the totals and one machine-readable line,
+//   [loop-summary] {"loop": "Cutflow", "events": 500000, ...}
+// that can be collected from batch logs with grep.
+//
+// Stages are timed with a StageTimer, which charges the time since it was
+// started (or last switched) to its stage when it is switched or goes out
+// of scope, so a `continue` anywhere in the loop body is accounted for:
+//   StageTimer timer(monitor, kStageRead);
+//   tree_reader->ReadEntry(entry);
+//   timer.Switch(kStageSelect);
+//   if (!monitor.Cut(kCutMET, met > 30)) continue;
+//
+// Branch bytes are the branch sizes of each file of the tree, scaled by the
+// fraction of the file's entries reached, so they assume that every file is
+// read front to back, as all our loops do. Loops that read branches
+// selectively (lazy_branches.h) count the bytes they read instead, through
+// CountBranches() and AddBranchBytes().
+//
+// The report interval defaults to 10 s and can be changed without touching
+// a macro through the ROOT resource LoopMonitor.ReportSeconds (in .rootrc,
+// or gEnv->SetValue("LoopMonitor.ReportSeconds", "60") in the session).
+//
+// A monitor belongs to one loop on one thread; nothing in it is shared.
+
+#ifndef LOOP_MONITOR_H
+#define LOOP_MONITOR_H
+
+#include <TBranch.h>
+#include <TEnv.h>
+#include <TTree.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+typedef std::chrono::steady_clock LoopClock;
+
+
+class LoopMonitor {
+ public:
+  // `total_entries` is only used for the "On event i / N" part of the
+  // reports. A non-positive `report_seconds` takes the resource value.
+  LoopMonitor(const char *name, Long64_t total_entries = 0, const char *tag = "",
+              Double_t report_seconds = 0)
+      : name(name), tag(tag), total_entries(total_entries),
+        report_seconds(report_seconds > 0 ? report_seconds
+                                          : gEnv->GetValue("LoopMonitor.ReportSeconds", 10.)) {
+    start = last_report = LoopClock::now();
+  }
+
+  // Names the stages; stage i is then timed with StageTimer(monitor, i).
+  void SetStages(const std::vector<std::string> &names) {
+    stage_names = names;
+    stage_seconds.assign(names.size(), 0.);
+  }
+
+  // Names the cuts; cut i is then counted with Cut(i, pass).
+  void SetCuts(const std::vector<std::string> &names) {
+    cut_names = names;
+    cut_tested.assign(names.size(), 0);
+    cut_passed.assign(names.size(), 0);
+    calibration_tested.assign(names.size(), 0);
+    calibration_passed.assign(names.size(), 0);
+  }
+
+  // Counts the following Cut() calls apart from the others, until called
+  // again with false.
+  void SetCalibrating(bool on) { calibrating = on; }
+
+  // Counts the bytes read from the branches `names` of `tree` (a TTree or
+  // a TChain). Unknown branches are reported as 0 bytes.
+  void WatchBranches(TTree *tree, const std::vector<std::string> &names) {
+    watched_tree = tree;
+    branch_names = names;
+    closed_bytes.assign(names.size(), 0);
+    closed_zip_bytes.assign(names.size(), 0);
+    file_bytes.assign(names.size(), 0);
+    file_zip_bytes.assign(names.size(), 0);
+    tree_number = -1;
+  }
+
+  // Reports bytes of the branches `names` as counted by AddBranchBytes()
+  // rather than from the branch sizes.
+  void CountBranches(const std::vector<std::string> &names) {
+    watched_tree = 0;
+    branch_names = names;
+    closed_bytes.assign(names.size(), 0);
+    closed_zip_bytes.assign(names.size(), 0);
+    file_bytes.assign(names.size(), 0);
+    file_zip_bytes.assign(names.size(), 0);
+  }
+
+  // Adds bytes read from branch `b` of CountBranches().
+  void AddBranchBytes(int b, Long64_t bytes, Long64_t zip_bytes) {
+    closed_bytes[b] += bytes;
+    closed_zip_bytes[b] += zip_bytes;
+  }
+
+  // Marks `n` more events done; `entry` is the first of them. Prints a
+  // report if one is due and returns whether it did, so other periodic
+  // output (e.g. MemoryMonitor) can follow the same schedule.
+  bool Event(Long64_t entry, Long64_t n = 1) {
+    current_entry = entry;
+    if (watched_tree && watched_tree->GetTreeNumber() != tree_number) NextFile();
+    events += n;
+    // Read the clock every 64 events at most.
+    if (events - last_check < 64 && n == 1) return false;
+    last_check = events;
+    if (Seconds(last_report, LoopClock::now()) < report_seconds) return false;
+    Report();
+    return true;
+  }
+
+  // Counts one event reaching cut `cut`; returns `pass`.
+  bool Cut(int cut, bool pass) {
+    if (calibrating) {
+      calibration_tested[cut]++;
+      if (pass) calibration_passed[cut]++;
+      return pass;
+    }
+    cut_tested[cut]++;
+    if (pass) cut_passed[cut]++;
+    return pass;
+  }
+
+  void AddStageTime(int stage, Double_t seconds) { stage_seconds[stage] += seconds; }
+
+  // Prints the progress report now.
+  void Report() {
+    LoopClock::time_point now = LoopClock::now();
+    Double_t since = Seconds(last_report, now);
+    Double_t rate_now = since > 0 ? (events - last_events) / since : 0.;
+    Double_t elapsed = Seconds(start, now);
+    Double_t rate = elapsed > 0 ? events / elapsed : 0.;
+
+    if (total_entries > 0) {
+      Double_t remaining = rate > 0 ? (total_entries - current_entry) / rate : 0.;
+      printf("%s[%s] On event %lld / %lld: %.1f events/s (%.1f now), %.0f s left \n",
+             tag.c_str(), name.c_str(), current_entry, total_entries, rate, rate_now, remaining);
+    } else {
+      printf("%s[%s] On event %lld: %.1f events/s (%.1f now) \n",
+             tag.c_str(), name.c_str(), current_entry, rate, rate_now);
+    }
+    PrintDetails(elapsed);
+    last_report = now;
+    last_events = events;
+  }
+
+  // Prints the totals over the loop and the [loop-summary] line.
+  void Summary() {
+    Double_t elapsed = Seconds(start, LoopClock::now());
+    Double_t rate = elapsed > 0 ? events / elapsed : 0.;
+    printf("%s[%s] total: %lld events in %.1f s, %.1f events/s \n",
+           tag.c_str(), name.c_str(), events, elapsed, rate);
+    PrintDetails(elapsed);
+
+    std::vector<Long64_t> bytes, zip_bytes;
+    BranchBytes(bytes, zip_bytes);
+    std::string line = "{\"loop\": " + Quote(name) + ", \"tag\": " + Quote(tag);
+    line += ", \"events\": " + std::to_string(events);
+    line += ", \"seconds\": " + Number(elapsed);
+    line += ", \"events_per_second\": " + Number(rate);
+    line += ", \"stages\": {";
+    for (size_t s = 0; s < stage_names.size(); ++s) {
+      line += Quote(stage_names[s]) + ": " + Number(stage_seconds[s]) + ", ";
+    }
+    line += "\"other\": " + Number(OtherSeconds(elapsed)) + "}";
+    line += ", \"branches\": {";
+    for (size_t b = 0; b < branch_names.size(); ++b) {
+      if (b > 0) line += ", ";
+      line += Quote(branch_names[b]) + ": {\"bytes\": " + std::to_string(bytes[b]) +
+              ", \"zip_bytes\": " + std::to_string(zip_bytes[b]) + "}";
+    }
+    line += "}, \"cuts\": " + CutsJson(cut_tested, cut_passed);
+    line += ", \"calibration_cuts\": " + CutsJson(calibration_tested, calibration_passed);
+    line += "}";
+    printf("[loop-summary] %s\n", line.c_str());
+  }
+
+  Long64_t Events() const { return events; }
+
+ private:
+  static Double_t Seconds(LoopClock::time_point a, LoopClock::time_point b) {
+    return std::chrono::duration<Double_t>(b - a).count();
+  }
+
+  Double_t OtherSeconds(Double_t elapsed) const {
+    Double_t other = elapsed;
+    for (Double_t s : stage_seconds) other -= s;
+    return other > 0 ? other : 0.;
+  }
+
+  // The previous file was read through; start counting the current one.
+  void NextFile() {
+    for (size_t b = 0; b < branch_names.size(); ++b) {
+      closed_bytes[b] += file_bytes[b];
+      closed_zip_bytes[b] += file_zip_bytes[b];
+      file_bytes[b] = file_zip_bytes[b] = 0;
+    }
+    tree_number = watched_tree->GetTreeNumber();
+    TTree *tree = watched_tree->GetTree();
+    if (!tree) return;
+    for (size_t b = 0; b < branch_names.size(); ++b) {
+      TBranch *branch = tree->GetBranch(branch_names[b].c_str());
+      if (!branch) continue;
+      file_bytes[b] = branch->GetTotBytes("*");
+      file_zip_bytes[b] = branch->GetZipBytes("*");
+    }
+  }
+
+  void BranchBytes(std::vector<Long64_t> &bytes, std::vector<Long64_t> &zip_bytes) const {
+    bytes = closed_bytes;
+    zip_bytes = closed_zip_bytes;
+    TTree *tree = watched_tree ? watched_tree->GetTree() : 0;
+    if (!tree || tree->GetEntries() <= 0) return;
+    Double_t fraction = (Double_t) (current_entry - tree->GetChainOffset() + 1) / tree->GetEntries();
+    if (fraction < 0) fraction = 0;
+    if (fraction > 1) fraction = 1;
+    for (size_t b = 0; b < branch_names.size(); ++b) {
+      bytes[b] += (Long64_t) (fraction * file_bytes[b]);
+      zip_bytes[b] += (Long64_t) (fraction * file_zip_bytes[b]);
+    }
+  }
+
+  void PrintDetails(Double_t elapsed) const {
+    if (!stage_names.empty() && elapsed > 0) {
+      printf("%s[%s]   time:", tag.c_str(), name.c_str());
+      for (size_t s = 0; s < stage_names.size(); ++s) {
+        printf(" %s %.1f%%,", stage_names[s].c_str(), 100. * stage_seconds[s] / elapsed);
+      }
+      printf(" other %.1f%% \n", 100. * OtherSeconds(elapsed) / elapsed);
+    }
+    if (!branch_names.empty()) {
+      std::vector<Long64_t> bytes, zip_bytes;
+      BranchBytes(bytes, zip_bytes);
+      printf("%s[%s]   read:", tag.c_str(), name.c_str());
+      for (size_t b = 0; b < branch_names.size(); ++b) {
+        printf(" %s %.1f MB (%.1f MB zipped)%s", branch_names[b].c_str(), bytes[b] / 1048576.,
+               zip_bytes[b] / 1048576., b + 1 < branch_names.size() ? "," : "");
+      }
+      printf(" \n");
+    }
+    if (!cut_names.empty()) PrintCuts("rejected", cut_tested, cut_passed);
+    for (Long64_t tested : calibration_tested) {
+      if (tested == 0) continue;
+      PrintCuts("rejected in calibration", calibration_tested, calibration_passed);
+      break;
+    }
+  }
+
+  void PrintCuts(const char *label, const std::vector<Long64_t> &tested,
+                 const std::vector<Long64_t> &passed) const {
+    printf("%s[%s]   %s:", tag.c_str(), name.c_str(), label);
+    for (size_t c = 0; c < cut_names.size(); ++c) {
+      Double_t rejected = tested[c] > 0 ? 1. - (Double_t) passed[c] / tested[c] : 0.;
+      printf(" %s %.1f%% of %lld%s", cut_names[c].c_str(), 100. * rejected, tested[c],
+             c + 1 < cut_names.size() ? "," : "");
+    }
+    printf(" \n");
+  }
+
+  std::string CutsJson(const std::vector<Long64_t> &tested,
+                       const std::vector<Long64_t> &passed) const {
+    std::string json = "{";
+    for (size_t c = 0; c < cut_names.size(); ++c) {
+      if (c > 0) json += ", ";
+      json += Quote(cut_names[c]) + ": {\"tested\": " + std::to_string(tested[c]) +
+              ", \"passed\": " + std::to_string(passed[c]) + "}";
+    }
+    return json + "}";
+  }
+
+  static std::string Quote(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      out += c;
+    }
+    return out + "\"";
+  }
+
+  static std::string Number(Double_t x) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6g", x);
+    return buffer;
+  }
+
+  std::string name, tag;
+  Long64_t total_entries;
+  Double_t report_seconds;
+  LoopClock::time_point start, last_report;
+  Long64_t events = 0, last_events = 0, last_check = 0, current_entry = 0;
+
+  std::vector<std::string> stage_names;
+  std::vector<Double_t> stage_seconds;
+
+  std::vector<std::string> cut_names;
+  std::vector<Long64_t> cut_tested, cut_passed;
+  std::vector<Long64_t> calibration_tested, calibration_passed;
+  bool calibrating = false;
+
+  TTree *watched_tree = 0;
+  Int_t tree_number = -1;
+  std::vector<std::string> branch_names;
+  std::vector<Long64_t> closed_bytes, closed_zip_bytes, file_bytes, file_zip_bytes;
+};
+
+
+// Charges wall time to one stage of a LoopMonitor at a time.
+class StageTimer {
+ public:
+  StageTimer(LoopMonitor &monitor, int stage)
+      : monitor(monitor), stage(stage), start(LoopClock::now()) {}
+
+  ~StageTimer() { Stop(); }
+
+  // Charges the time so far to the current stage and starts timing `next`.
+  void Switch(int next) {
+    LoopClock::time_point now = LoopClock::now();
+    if (stage >= 0) monitor.AddStageTime(stage, std::chrono::duration<Double_t>(now - start).count());
+    stage = next;
+    start = now;
+  }
+
+  // Charges the time so far; nothing more is timed.
+  void Stop() { Switch(-1); }
+
+ private:
+  LoopMonitor &monitor;
+  int stage;
+  LoopClock::time_point start;
+};
+
+#endif
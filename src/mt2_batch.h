@@ -0,0 +1,296 @@
+// Batched MT2 on top of asymm_mt2_lester_bisect.
+//
+// BatchMT2() runs Lester's bisection for many events at once. Events are
+// loaded into kMT2Lanes lanes; every step evaluates the ellipse
+// disjointness test for all lanes in one loop over lane-indexed arrays
+// (which the compiler vectorises), then advances each lane on its own. A
+// lane that has converged is immediately refilled with the next event, so
+// slow events do not hold the others back.
+//
+// Each lane follows exactly the steps of get_mT2_Sq() (same deci-section
+// start, upper bound search, precision test and degenerate-ellipse
+// handling), so the results are identical to calling get_mT2() per event
+// with the same desiredPrecisionOnMT2, as long as the compiler does not
+// contract the two differently into FMAs.
+//
+// desiredPrecisionOnMT2 (GeV, on MT2 itself) is the throughput knob: an
+// exact solve (0) bisects down to the last digits of machine precision,
+// far below any histogram bin width we use. What batching gains on top
+// depends on the vector width of the host; BenchmarkKernels.C times
+// get_mT2 and BatchMT2 at each of kBenchmarkMT2Precisions.
+
+#ifndef MT2_BATCH_H
+#define MT2_BATCH_H
+
+#include "lester_mt2_bisect.h"
+
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+
+const int kMT2Lanes = 8;
+
+
+// Per-event inputs, one array entry per event. Null mass arrays mean
+// massless visible objects.
+struct MT2BatchInput {
+  const double *mVis1 = 0;
+  const double *pxVis1 = 0;
+  const double *pyVis1 = 0;
+  const double *mVis2 = 0;
+  const double *pxVis2 = 0;
+  const double *pyVis2 = 0;
+  const double *pxMiss = 0;
+  const double *pyMiss = 0;
+  double mInvis1 = 0;
+  double mInvis2 = 0;
+};
+
+
+// Coefficients (c_xx, c_yy, c_xy, c_x, c_y, c, det) of one side's ellipse,
+// as asymm_mt2_lester_bisect::helper() and EllipseParams compute them.
+inline void MT2EllipseCoeffs(const double mSq, const double mtSq,
+                             const double tx, const double ty, const double mqSq,
+                             const double pxmiss, const double pymiss, double *e) {
+  const double txSq = tx*tx;
+  const double tySq = ty*ty;
+  const double pxmissSq = pxmiss*pxmiss;
+  const double pymissSq = pymiss*pymiss;
+
+  const double c_xx = +4.0* mtSq + 4.0* tySq;
+  const double c_yy = +4.0* mtSq + 4.0* txSq;
+  const double c_xy = -4.0* tx*ty;
+  const double c_x  = -4.0* mtSq*pxmiss - 2.0* mqSq*tx + 2.0* mSq*tx - 2.0* mtSq*tx  +
+             4.0* pymiss*tx*ty - 4.0* pxmiss*tySq;
+  const double c_y  = -4.0* mtSq*pymiss - 4.0* pymiss*txSq - 2.0* mqSq*ty + 2.0* mSq*ty - 2.0* mtSq*ty +
+             4.0* pxmiss*tx*ty;
+  const double c =   - mqSq*mqSq + 2*mqSq*mSq - mSq*mSq + 2*mqSq*mtSq + 2*mSq*mtSq - mtSq*mtSq +
+              4.0* mtSq*pxmissSq + 4.0* mtSq*pymissSq + 4.0* mqSq*pxmiss*tx -
+              4.0* mSq*pxmiss*tx + 4.0* mtSq*pxmiss*tx + 4.0* mqSq*txSq +
+              4.0* pymissSq*txSq + 4.0* mqSq*pymiss*ty - 4.0* mSq*pymiss*ty +
+              4.0* mtSq*pymiss*ty - 8.0* pxmiss*pymiss*tx*ty + 4.0* mqSq*tySq +
+              4.0* pxmissSq*tySq;
+
+  e[0] = c_xx; e[1] = c_yy; e[2] = c_xy; e[3] = c_x; e[4] = c_y; e[5] = c;
+  e[6] = (2.0*c_x*c_xy*c_y + c*c_xx*c_yy - c_yy*c_x*c_x - c*c_xy*c_xy - c_xx*c_y*c_y);
+}
+
+
+// EllipseParams::lesterFactor(), e1.lesterFactor(e2).
+inline double MT2LesterFactor(const double *e1, const double *e2) {
+  return e1[0]*e1[1]*e2[5] + 2.0*e1[2]*e1[4]*e2[3] - 2.0*e1[3]*e1[1]*e2[3] + e1[5]*e1[1]*e2[0] - 2.0*e1[5]*e1[2]*e2[2] + 2.0*e1[3]*e1[4]*e2[2] + 2.0*e1[3]*e1[2]*e2[4] - 2.0*e1[0]*e1[4]*e2[4] + e1[5]*e1[0]*e2[1] - e2[1]*(e1[3]*e1[3]) - e2[5]*(e1[2]*e1[2]) - e2[0]*(e1[4]*e1[4]);
+}
+
+
+// Outcomes of the disjointness test of one lane.
+const int kMT2Overlap = 0;
+const int kMT2Disjoint = 1;
+const int kMT2Singular = 2;  // Lester::ellipsesAreDisjoint() throws.
+
+
+// Lester::ellipsesAreDisjoint() on the cubic Det(lambda A + B), given its
+// coefficients and whether the ellipses were identical.
+inline int MT2Outcome(const bool same, const double coeffLamPow3_in,
+                      const double coeffLamPow2_in, const double coeffLamPow1_in,
+                      const double coeffLamPow0_in) {
+  if (same) return kMT2Overlap;
+
+  const bool normal = fabs(coeffLamPow3_in) >= fabs(coeffLamPow0_in);
+  const double coeffLamPow3 = normal ? coeffLamPow3_in : coeffLamPow0_in;
+  const double coeffLamPow2 = normal ? coeffLamPow2_in : coeffLamPow1_in;
+  const double coeffLamPow1 = normal ? coeffLamPow1_in : coeffLamPow2_in;
+  const double coeffLamPow0 = normal ? coeffLamPow0_in : coeffLamPow3_in;
+  if (coeffLamPow3 == 0) return kMT2Singular;
+
+  const double a = coeffLamPow2 / coeffLamPow3;
+  const double b = coeffLamPow1 / coeffLamPow3;
+  const double c = coeffLamPow0 / coeffLamPow3;
+  const double thing1 = -3.0*b + a*a;
+  if (thing1 <= 0) return kMT2Overlap;
+  const double thing2 = -27.0*c*c + 18.0*c*a*b + a*a*b*b - 4.0*a*a*a*c - 4.0*b*b*b;
+  if (thing2 <= 0) return kMT2Overlap;
+
+  const bool ans = ( (a >= 0 && 3.0*a*c + b*a*a - 4.0*b*b< 0) || (a <  0) );
+  return ans ? kMT2Disjoint : kMT2Overlap;
+}
+
+
+// The vectorised part of BatchMT2(): for every lane, both ellipses at the
+// lane's trial mass and the coefficients of their characteristic cubic.
+// Straight-line arithmetic over lane-indexed arrays; the e1 == e2 test of
+// ellipsesAreDisjoint() is left to MT2SameEllipses().
+inline void MT2LaneCubics(const double *trial_m,
+                          const double *ms_sq, const double *sx, const double *sy, const double *mp_sq,
+                          const double *mt_sq, const double *tx, const double *ty, const double *mq_sq,
+                          const double *px_miss, const double *py_miss,
+                          double *lam3, double *lam2, double *lam1, double *lam0) {
+  for (int l = 0; l < kMT2Lanes; ++l) {
+    const double mSq = trial_m[l]*trial_m[l];
+    double e1[7], e2[7];
+    MT2EllipseCoeffs(mSq, ms_sq[l], -sx[l], -sy[l], mp_sq[l], 0, 0, e1);
+    MT2EllipseCoeffs(mSq, mt_sq[l], +tx[l], +ty[l], mq_sq[l], px_miss[l], py_miss[l], e2);
+    lam3[l] = e1[6];
+    lam2[l] = MT2LesterFactor(e1, e2);
+    lam1[l] = MT2LesterFactor(e2, e1);
+    lam0[l] = e2[6];
+  }
+}
+
+
+// The e1 == e2 test of ellipsesAreDisjoint() at mass mSq.
+inline bool MT2SameEllipses(const double mSq,
+                            const double ms_sq, const double sx, const double sy, const double mp_sq,
+                            const double mt_sq, const double tx, const double ty, const double mq_sq,
+                            const double px_miss, const double py_miss) {
+  double e1[7], e2[7];
+  MT2EllipseCoeffs(mSq, ms_sq, -sx, -sy, mp_sq, 0, 0, e1);
+  MT2EllipseCoeffs(mSq, mt_sq, +tx, +ty, mq_sq, px_miss, py_miss, e2);
+  return e1[0] == e2[0] && e1[1] == e2[1] && e1[2] == e2[2] &&
+         e1[3] == e2[3] && e1[4] == e2[4] && e1[5] == e2[5];
+}
+
+
+// Writes MT2 of events [0, n) to mt2[], or MT2_ERROR where get_mT2() fails.
+void BatchMT2(const MT2BatchInput &in, int n, double *mt2,
+              const double desiredPrecisionOnMT2 = 0) {
+  asymm_mt2_lester_bisect::disableCopyrightMessage(true);
+
+  // Lane state: -1 idle, 0 searching for an upper bound, 1 bisecting.
+  int phase[kMT2Lanes] = {}, event[kMT2Lanes] = {};
+  unsigned int attempts[kMT2Lanes] = {};
+  bool go_low[kMT2Lanes] = {};
+  double ms_sq[kMT2Lanes] = {}, sx[kMT2Lanes] = {}, sy[kMT2Lanes] = {}, mp_sq[kMT2Lanes] = {};
+  double mt_sq[kMT2Lanes] = {}, tx[kMT2Lanes] = {}, ty[kMT2Lanes] = {}, mq_sq[kMT2Lanes] = {};
+  double px_miss[kMT2Lanes] = {}, py_miss[kMT2Lanes] = {};
+  double m_lower[kMT2Lanes] = {}, m_upper[kMT2Lanes] = {}, trial_m[kMT2Lanes] = {};
+  double lam3[kMT2Lanes], lam2[kMT2Lanes], lam1[kMT2Lanes], lam0[kMT2Lanes];
+  // c_xx, c_yy and c_xy do not depend on the trial mass; only lanes where
+  // they agree can ever see identical ellipses.
+  bool check_same[kMT2Lanes] = {};
+
+  const unsigned int maxAttempts = 10000;
+  int next = 0;
+  int active = 0;
+  for (int l = 0; l < kMT2Lanes; ++l) phase[l] = -1;
+
+  // Loads the next event that needs a bisection into lane l.
+  auto refill = [&](int l) {
+    phase[l] = -1;
+    while (next < n) {
+      int i = next++;
+      double mVis1 = in.mVis1 ? in.mVis1[i] : 0.0, mVis2 = in.mVis2 ? in.mVis2[i] : 0.0;
+      double px1 = in.pxVis1[i], py1 = in.pyVis1[i];
+      double px2 = in.pxVis2[i], py2 = in.pyVis2[i];
+      double mInvis1 = in.mInvis1, mInvis2 = in.mInvis2;
+      if (mVis1 + mInvis1 > mVis2 + mInvis2) {
+        std::swap(mVis1, mVis2);
+        std::swap(px1, px2);
+        std::swap(py1, py2);
+        std::swap(mInvis1, mInvis2);
+      }
+
+      ms_sq[l] = mVis1*mVis1;
+      sx[l] = px1;
+      sy[l] = py1;
+      mp_sq[l] = mInvis1*mInvis1;
+      mt_sq[l] = mVis2*mVis2;
+      tx[l] = px2;
+      ty[l] = py2;
+      mq_sq[l] = mInvis2*mInvis2;
+      px_miss[l] = in.pxMiss[i];
+      py_miss[l] = in.pyMiss[i];
+
+      const double sSq = sx[l]*sx[l] + sy[l]*sy[l];
+      const double tSq = tx[l]*tx[l] + ty[l]*ty[l];
+      const double pMissSq = px_miss[l]*px_miss[l] + py_miss[l]*py_miss[l];
+      const double massSqSum = ms_sq[l] + mt_sq[l] + mp_sq[l] + mq_sq[l];
+      const double scaleSq = (massSqSum + sSq + tSq + pMissSq)/8.0;
+      if (scaleSq == 0) {
+        mt2[i] = 0;
+        continue;
+      }
+
+      const double s_tx = -sx[l], s_ty = -sy[l];
+      check_same[l] = (+4.0* ms_sq[l] + 4.0* (s_ty*s_ty) == +4.0* mt_sq[l] + 4.0* (ty[l]*ty[l])) &&
+                      (+4.0* ms_sq[l] + 4.0* (s_tx*s_tx) == +4.0* mt_sq[l] + 4.0* (tx[l]*tx[l])) &&
+                      (-4.0* s_tx*s_ty == -4.0* tx[l]*ty[l]);
+      event[l] = i;
+      phase[l] = 0;
+      attempts[l] = 0;
+      go_low[l] = true;
+      m_lower[l] = mVis2 + mInvis2;
+      m_upper[l] = m_lower[l] + sqrt(scaleSq);
+      return;
+    }
+  };
+
+  auto finish = [&](int l, double mt2_sq) {
+    mt2[event[l]] = mt2_sq == asymm_mt2_lester_bisect::MT2_ERROR ?
+                    asymm_mt2_lester_bisect::MT2_ERROR : sqrt(mt2_sq);
+    refill(l);
+    if (phase[l] < 0) active--;
+  };
+
+  for (int l = 0; l < kMT2Lanes; ++l) {
+    refill(l);
+    if (phase[l] >= 0) active++;
+  }
+
+  while (active > 0) {
+    // Pick the trial mass of every lane, finishing lanes that converged.
+    for (int l = 0; l < kMT2Lanes; ++l) {
+      while (phase[l] == 1) {
+        if (!(desiredPrecisionOnMT2 <= 0 || m_upper[l] - m_lower[l] > desiredPrecisionOnMT2)) {
+          const double mAns = (m_lower[l] + m_upper[l])/2.0;
+          finish(l, mAns*mAns);
+          continue;
+        }
+        trial_m[l] = (go_low[l] ? (m_lower[l]*15 + m_upper[l])/16 : (m_upper[l] + m_lower[l])/2.0);
+        if (trial_m[l] <= m_lower[l] || trial_m[l] >= m_upper[l]) {
+          finish(l, trial_m[l]*trial_m[l]);
+          continue;
+        }
+        break;
+      }
+      if (phase[l] == 0) trial_m[l] = m_upper[l];
+      if (phase[l] < 0) trial_m[l] = 1;  // Idle lanes are evaluated but ignored.
+    }
+    if (active == 0) break;
+
+    MT2LaneCubics(trial_m, ms_sq, sx, sy, mp_sq, mt_sq, tx, ty, mq_sq,
+                  px_miss, py_miss, lam3, lam2, lam1, lam0);
+
+    // Advance each lane.
+    for (int l = 0; l < kMT2Lanes; ++l) {
+      const bool same = check_same[l] &&
+                        MT2SameEllipses(trial_m[l]*trial_m[l], ms_sq[l], sx[l], sy[l], mp_sq[l],
+                                        mt_sq[l], tx[l], ty[l], mq_sq[l], px_miss[l], py_miss[l]);
+      const int outcome = MT2Outcome(same, lam3[l], lam2[l], lam1[l], lam0[l]);
+      if (phase[l] == 0) {
+        attempts[l]++;
+        if (outcome == kMT2Singular) {
+          finish(l, asymm_mt2_lester_bisect::MT2_ERROR);
+        } else if (outcome == kMT2Overlap) {
+          phase[l] = 1;
+        } else if (attempts[l] >= maxAttempts) {
+          std::cerr << "MT2 algorithm failed to find upper bound to MT2" << std::endl;
+          finish(l, asymm_mt2_lester_bisect::MT2_ERROR);
+        } else {
+          m_upper[l] *= 2;
+        }
+      } else if (phase[l] == 1) {
+        if (outcome == kMT2Singular) {
+          finish(l, m_lower[l]*m_lower[l]);
+        } else if (outcome == kMT2Disjoint) {
+          m_lower[l] = trial_m[l];
+          go_low[l] = false;
+        } else {
+          m_upper[l] = trial_m[l];
+        }
+      }
+    }
+  }
+}
+
+#endif
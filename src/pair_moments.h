@@ -0,0 +1,273 @@
+// Streaming means and covariances of variable pairs, in place of 2D
+// histograms that are only read for their GetMean() / GetStdDev().
+//
+// PairMoments keeps the weighted mean of x and y and the weighted sums of
+// squared deviations from it, updated one event at a time (Welford, with
+// West's weighted form). Unlike TH1's sums of w x, w x^2, ..., the
+// variance is not a difference of two large numbers, so it keeps its
+// precision for any offset and number of events; and unlike a TH2 it is
+// not binned, so the means and standard deviations are exact and no event
+// falls outside an axis range. Two PairMoments of disjoint events merge
+// exactly (Chan et al.), in any order, which is how threads and shards are
+// combined.
+//
+// A MomentSet is the HistogramSet (histogram_set.h) counterpart: a table of
+// MomentSpecs, each a pair of Columns of the analyzer's block, with the
+// same event weight and cut options, filled a block at a time. Each pair
+// is saved as a TVectorD of kPairMomentFields numbers, so a sample's
+// topology summary is a few hundred bytes. TopoPlotter.C draws them.
+
+#ifndef PAIR_MOMENTS_H
+#define PAIR_MOMENTS_H
+
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TKey.h>
+#include <TVectorD.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "histogram_set.h"
+
+
+const char *kStructuredMomentFile = "analyzer_moments.root";
+
+// Layout of a saved PairMoments.
+enum PairMomentField {
+  kMomentEntries, kMomentSumW, kMomentSumW2, kMomentMeanX, kMomentMeanY,
+  kMomentM2X, kMomentM2Y, kMomentCXY, kPairMomentFields
+};
+
+
+struct PairMoments {
+  Double_t entries = 0;
+  Double_t sum_w = 0;
+  Double_t sum_w2 = 0;
+  Double_t mean_x = 0;
+  Double_t mean_y = 0;
+  Double_t m2_x = 0;  // sum w (x - mean_x)^2
+  Double_t m2_y = 0;  // sum w (y - mean_y)^2
+  Double_t c_xy = 0;  // sum w (x - mean_x)(y - mean_y)
+
+  void Add(Double_t x, Double_t y, Double_t w = 1.) {
+    entries += 1;
+    sum_w += w;
+    sum_w2 += w*w;
+    if (sum_w == 0) return;
+    Double_t dx = x - mean_x;
+    Double_t dy = y - mean_y;
+    mean_x += dx * w / sum_w;
+    mean_y += dy * w / sum_w;
+    m2_x += w * dx * (x - mean_x);
+    m2_y += w * dy * (y - mean_y);
+    c_xy += w * dx * (y - mean_y);
+  }
+
+  // Adds the events of `other`.
+  void Merge(const PairMoments &other) {
+    if (other.sum_w == 0) {
+      entries += other.entries;
+      return;
+    }
+    Double_t w = sum_w + other.sum_w;
+    Double_t dx = other.mean_x - mean_x;
+    Double_t dy = other.mean_y - mean_y;
+    Double_t f = w != 0 ? sum_w * other.sum_w / w : 0;
+    if (w != 0) {
+      mean_x += dx * other.sum_w / w;
+      mean_y += dy * other.sum_w / w;
+    }
+    m2_x += other.m2_x + dx * dx * f;
+    m2_y += other.m2_y + dy * dy * f;
+    c_xy += other.c_xy + dx * dy * f;
+    entries += other.entries;
+    sum_w = w;
+    sum_w2 += other.sum_w2;
+  }
+
+  // Multiplies every weight by `factor` > 0.
+  void Scale(Double_t factor) {
+    sum_w *= factor;
+    sum_w2 *= factor * factor;
+    m2_x *= factor;
+    m2_y *= factor;
+    c_xy *= factor;
+  }
+
+  // Variances with the sum of weights as denominator, as TH1::GetStdDev.
+  Double_t VarianceX() const { return sum_w > 0 ? std::max(m2_x / sum_w, 0.) : 0; }
+  Double_t VarianceY() const { return sum_w > 0 ? std::max(m2_y / sum_w, 0.) : 0; }
+  Double_t StdDevX() const { return sqrt(VarianceX()); }
+  Double_t StdDevY() const { return sqrt(VarianceY()); }
+  Double_t Covariance() const { return sum_w > 0 ? c_xy / sum_w : 0; }
+
+  Double_t Correlation() const {
+    Double_t s = StdDevX() * StdDevY();
+    return s > 0 ? Covariance() / s : 0;
+  }
+
+  Double_t EffectiveEntries() const { return sum_w2 > 0 ? sum_w * sum_w / sum_w2 : 0; }
+
+  TVectorD ToVector() const {
+    TVectorD v(kPairMomentFields);
+    v[kMomentEntries] = entries;
+    v[kMomentSumW] = sum_w;
+    v[kMomentSumW2] = sum_w2;
+    v[kMomentMeanX] = mean_x;
+    v[kMomentMeanY] = mean_y;
+    v[kMomentM2X] = m2_x;
+    v[kMomentM2Y] = m2_y;
+    v[kMomentCXY] = c_xy;
+    return v;
+  }
+
+  // From a vector saved by ToVector(); false if `v` has another layout.
+  bool FromVector(const TVectorD &v) {
+    if (v.GetNrows() != kPairMomentFields) return false;
+    entries = v[kMomentEntries];
+    sum_w = v[kMomentSumW];
+    sum_w2 = v[kMomentSumW2];
+    mean_x = v[kMomentMeanX];
+    mean_y = v[kMomentMeanY];
+    m2_x = v[kMomentM2X];
+    m2_y = v[kMomentM2Y];
+    c_xy = v[kMomentCXY];
+    return true;
+  }
+};
+
+
+// Reads the PairMoments saved under `key` of `dir`.
+bool ReadPairMoments(TDirectory *dir, const char *key, PairMoments &m) {
+  TVectorD *v = 0;
+  dir->GetObject(key, v);
+  bool ok = v && m.FromVector(*v);
+  delete v;
+  return ok;
+}
+
+
+template <class Block>
+struct MomentSpec {
+  const char *key;    // Output key.
+  Column Block::*x;
+  Column Block::*y;
+  HistogramWeighting weighting;
+  UInt_t cuts;        // Cut bits that must all be set.
+};
+
+
+template <class Block>
+MomentSpec<Block> Moments(const char *key, Column Block::*x, Column Block::*y,
+                          HistogramWeighting weighting = kUnweighted, UInt_t cuts = 0) {
+  MomentSpec<Block> spec = {key, x, y, weighting, cuts};
+  return spec;
+}
+
+
+template <class Block>
+class MomentSet {
+ public:
+  MomentSet(const std::vector<MomentSpec<Block> > &specs,
+            Column Block::*weight = 0, CutColumn Block::*cuts = 0)
+      : specs(specs), moments(specs.size()), weight(weight), cuts(cuts) {}
+
+  // Adds events [0, n) of `block`. Events with a non-finite x or y are
+  // left out.
+  void Fill(const Block &block, int n) {
+    const Double_t *w = weight ? block.*weight : 0;
+    const UInt_t *cut_bits = cuts ? block.*cuts : 0;
+
+    for (size_t j = 0; j < specs.size(); ++j) {
+      const MomentSpec<Block> &s = specs[j];
+      const Double_t *x = block.*(s.x);
+      const Double_t *y = block.*(s.y);
+      const Double_t *ew = s.weighting == kEventWeight ? w : 0;
+      PairMoments &m = moments[j];
+
+      for (int i = 0; i < n; ++i) {
+        if (s.cuts && (!cut_bits || (cut_bits[i] & s.cuts) != s.cuts)) continue;
+        if (!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+        m.Add(x[i], y[i], ew ? ew[i] : 1.);
+      }
+    }
+  }
+
+  // Adds the events of a set with the same table, e.g. of another thread.
+  void Merge(const MomentSet &other) {
+    for (size_t j = 0; j < moments.size() && j < other.moments.size(); ++j) {
+      moments[j].Merge(other.moments[j]);
+    }
+  }
+
+  void Scale(Double_t factor) {
+    for (PairMoments &m : moments) m.Scale(factor);
+  }
+
+  // Adds the moments saved under their keys in `dir` by Write(), e.g. by a
+  // job over other events of the same sample.
+  bool Add(TDirectory *dir) {
+    for (size_t j = 0; j < specs.size(); ++j) {
+      PairMoments m;
+      if (!dir || !ReadPairMoments(dir, specs[j].key, m)) {
+        printf("No moments %s in %s \n", specs[j].key, dir ? dir->GetPath() : "(null)");
+        return false;
+      }
+      moments[j].Merge(m);
+    }
+    return true;
+  }
+
+  void Write(TDirectory *dir) const {
+    for (size_t j = 0; j < specs.size(); ++j) {
+      TVectorD v = moments[j].ToVector();
+      dir->WriteTObject(&v, specs[j].key, "Overwrite");
+    }
+  }
+
+  const PairMoments *Get(const char *key) const {
+    for (size_t j = 0; j < specs.size(); ++j) {
+      if (strcmp(specs[j].key, key) == 0) return &moments[j];
+    }
+    printf("No moments %s in set \n", key);
+    return 0;
+  }
+
+  size_t Size() const { return specs.size(); }
+
+ private:
+  std::vector<MomentSpec<Block> > specs;
+  std::vector<PairMoments> moments;
+  Column Block::*weight;
+  CutColumn Block::*cuts;
+};
+
+
+// Writes `moments` into directory `sample_desc` of `output_file`, as
+// WriteSampleHistograms() does for histograms.
+template <class Block>
+bool WriteSampleMoments(const char *output_file, const char *sample_desc,
+                        const MomentSet<Block> &moments) {
+  TFile *f = TFile::Open(output_file, "UPDATE");
+  if (!f || f->IsZombie()) {
+    printf("Could not open %s \n", output_file);
+    delete f;
+    return false;
+  }
+
+  TDirectory *dir = f->GetDirectory(sample_desc);
+  if (!dir) dir = f->mkdir(sample_desc);
+  moments.Write(dir);
+
+  f->Close();
+  delete f;
+  printf("Wrote %zu moment pairs for %s to %s \n", moments.Size(), sample_desc, output_file);
+  return true;
+}
+
+#endif
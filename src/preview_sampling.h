@@ -0,0 +1,227 @@
+// Stratified random subsamples for quick previews of a selection, with
+// error bars, in place of "break after the first N events".
+//
+// The entries of a sample are split into strata (the files of a chain, or
+// consecutive ranges of a skim tree, i.e. the MadGraph runs), and each
+// stratum is read in its own random order: a StratifiedSampler draws the
+// next entries of every stratum, in proportion to its size, each time the
+// sampled fraction is raised. Within a stratum the entries drawn so far are
+// a simple random sample without replacement; the order is a shuffle
+// seeded from (seed, stratum), so a preview is reproducible and raising
+// the fraction only adds entries. Each stratum keeps its shuffled order as
+// 4 bytes per entry.
+//
+// A StratifiedCutflow tallies, per stratum, the sampled entries, how many
+// pass each stage of a cutflow and the sum and sum of squares of a value y
+// per entry (e.g. the weight of accepted events, 0 otherwise). It gives
+// the usual stratified estimates with W_h = N_h / N and f_h = n_h / N_h,
+//
+//   eff_k = sum_h W_h p_hk,     var = sum_h W_h^2 (1 - f_h) p_hk (1 - p_hk) / (n_h - 1)
+//   Y     = sum_h N_h ybar_h,   var = sum_h N_h^2 (1 - f_h) s_h^2 / n_h
+//
+// A preview raises the fraction until every efficiency has a relative
+// error below the target (NextPreviewFraction()), or a maximum fraction.
+
+#ifndef PREVIEW_SAMPLING_H
+#define PREVIEW_SAMPLING_H
+
+#include <Rtypes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+
+class StratifiedSampler {
+ public:
+  StratifiedSampler(const std::vector<Long64_t> &stratum_sizes, ULong64_t seed = 1)
+      : sizes(stratum_sizes), offsets(stratum_sizes.size(), 0), drawn(stratum_sizes.size(), 0),
+        order(stratum_sizes.size()), seed(seed) {
+    for (size_t h = 1; h < sizes.size(); ++h) offsets[h] = offsets[h - 1] + sizes[h - 1];
+  }
+
+  // Raises every stratum to ceil(fraction * N_h) entries drawn, at least
+  // two (or all of a smaller stratum), and returns the entries added, as
+  // indices into the whole sample in increasing order.
+  std::vector<Long64_t> Extend(Double_t fraction) {
+    std::vector<Long64_t> entries;
+    for (size_t h = 0; h < sizes.size(); ++h) {
+      Long64_t target = (Long64_t) ceil(std::min(fraction, 1.) * sizes[h]);
+      target = std::min(sizes[h], std::max(target, (Long64_t) 2));
+      if (target <= drawn[h]) continue;
+      if (order[h].empty()) Shuffle(h);
+      for (Long64_t i = drawn[h]; i < target; ++i) entries.push_back(offsets[h] + order[h][i]);
+      drawn[h] = target;
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+  }
+
+  int Strata() const { return sizes.size(); }
+  Long64_t Size(int h) const { return sizes[h]; }
+  Long64_t Drawn(int h) const { return drawn[h]; }
+
+  Long64_t Total() const {
+    Long64_t n = 0;
+    for (Long64_t s : sizes) n += s;
+    return n;
+  }
+
+  Long64_t TotalDrawn() const {
+    Long64_t n = 0;
+    for (Long64_t d : drawn) n += d;
+    return n;
+  }
+
+  // The stratum of entry `entry` of the whole sample.
+  int StratumOf(Long64_t entry) const {
+    return std::upper_bound(offsets.begin(), offsets.end(), entry) - offsets.begin() - 1;
+  }
+
+  bool Exhausted() const { return TotalDrawn() == Total(); }
+
+ private:
+  void Shuffle(size_t h) {
+    order[h].resize(sizes[h]);
+    for (Long64_t i = 0; i < sizes[h]; ++i) order[h][i] = i;
+    std::seed_seq seq{(UInt_t) seed, (UInt_t) (seed >> 32), (UInt_t) h};
+    std::mt19937_64 rng(seq);
+    std::shuffle(order[h].begin(), order[h].end(), rng);
+  }
+
+  std::vector<Long64_t> sizes, offsets, drawn;
+  std::vector<std::vector<UInt_t> > order;
+  ULong64_t seed;
+};
+
+
+struct PreviewEstimate {
+  Double_t value = 0;
+  Double_t error = 0;
+
+  Double_t RelativeError() const {
+    return value != 0 ? fabs(error / value) : std::numeric_limits<Double_t>::infinity();
+  }
+};
+
+
+class StratifiedCutflow {
+ public:
+  StratifiedCutflow(const std::vector<std::string> &stages,
+                    const std::vector<Long64_t> &stratum_sizes)
+      : stages(stages), sizes(stratum_sizes), tallies(stratum_sizes.size()) {
+    for (Tally &t : tallies) t.pass.assign(stages.size(), 0.);
+  }
+
+  // Adds `n` sampled entries of stratum h, of which pass[k] passed stage
+  // k, with sum_y and sum_y2 the sums of y and y^2 over them.
+  void Add(int h, Double_t n, const std::vector<Double_t> &pass, Double_t sum_y = 0,
+           Double_t sum_y2 = 0) {
+    Tally &t = tallies[h];
+    t.n += n;
+    for (size_t k = 0; k < pass.size() && k < t.pass.size(); ++k) t.pass[k] += pass[k];
+    t.sum_y += sum_y;
+    t.sum_y2 += sum_y2;
+  }
+
+  // Fraction of the whole sample passing stage k.
+  PreviewEstimate Efficiency(int k) const {
+    Double_t total = Total();
+    PreviewEstimate e;
+    for (size_t h = 0; h < tallies.size(); ++h) {
+      const Tally &t = tallies[h];
+      if (t.n <= 0) continue;
+      Double_t w = sizes[h] / total;
+      Double_t p = t.pass[k] / t.n;
+      e.value += w * p;
+      if (t.n > 1) e.error += w * w * FinitePopulation(h) * p * (1 - p) / (t.n - 1);
+    }
+    e.error = sqrt(e.error);
+    return e;
+  }
+
+  // Sum of y over the whole sample.
+  PreviewEstimate SumY() const {
+    PreviewEstimate e;
+    for (size_t h = 0; h < tallies.size(); ++h) {
+      const Tally &t = tallies[h];
+      if (t.n <= 0) continue;
+      Double_t mean = t.sum_y / t.n;
+      e.value += sizes[h] * mean;
+      if (t.n > 1) {
+        Double_t s2 = std::max((t.sum_y2 - t.n * mean * mean) / (t.n - 1), 0.);
+        e.error += (Double_t) sizes[h] * sizes[h] * FinitePopulation(h) * s2 / t.n;
+      }
+    }
+    e.error = sqrt(e.error);
+    return e;
+  }
+
+  // The largest relative error of the stage efficiencies; infinite while a
+  // stage has no passing entry.
+  Double_t MaxRelativeError() const {
+    Double_t worst = 0;
+    for (size_t k = 0; k < stages.size(); ++k) {
+      worst = std::max(worst, Efficiency(k).RelativeError());
+    }
+    return worst;
+  }
+
+  Double_t Sampled() const {
+    Double_t n = 0;
+    for (const Tally &t : tallies) n += t.n;
+    return n;
+  }
+
+  void Print(const char *name) const {
+    printf("%s: %.0f of %.0f entries sampled (%.2f%%) in %zu strata \n", name, Sampled(),
+           Total(), 100 * Sampled() / Total(), sizes.size());
+    for (size_t k = 0; k < stages.size(); ++k) {
+      PreviewEstimate e = Efficiency(k);
+      printf("  %-16s eff = %.5f +- %.5f (%.1f%%), ~%.0f +- %.0f events \n", stages[k].c_str(),
+             e.value, e.error, 100 * e.RelativeError(), e.value * Total(), e.error * Total());
+    }
+  }
+
+ private:
+  struct Tally {
+    Double_t n = 0;
+    std::vector<Double_t> pass;
+    Double_t sum_y = 0;
+    Double_t sum_y2 = 0;
+  };
+
+  Double_t Total() const {
+    Double_t n = 0;
+    for (Long64_t s : sizes) n += s;
+    return n;
+  }
+
+  Double_t FinitePopulation(size_t h) const {
+    return sizes[h] > 0 ? std::max(1 - tallies[h].n / sizes[h], 0.) : 0;
+  }
+
+  std::vector<std::string> stages;
+  std::vector<Long64_t> sizes;
+  std::vector<Tally> tallies;
+};
+
+
+// The next sampled fraction of a preview at `fraction` with relative error
+// `rel_error`: what 1/sqrt(n) scaling says reaches `target`, with 20%
+// margin, growing by a factor between 1.5 and 8 and capped at
+// `max_fraction`.
+Double_t NextPreviewFraction(Double_t fraction, Double_t rel_error, Double_t target,
+                             Double_t max_fraction) {
+  Double_t factor = 8;
+  if (std::isfinite(rel_error) && target > 0) {
+    factor = std::max(1.5, std::min(8., 1.2 * pow(rel_error / target, 2)));
+  }
+  return std::min(fraction * factor, max_fraction);
+}
+
+#endif
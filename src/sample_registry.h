@@ -0,0 +1,216 @@
+// Sample registry: maps sample names ("signal_50", "ttW", "EWK", ...) to
+// their input files, cross-sections and cached per-file entry counts, so a
+// new MadGraph run only means adding a line to a text file.
+//
+// A registry file holds one directive per line:
+//
+//   sample <name>        starts a new sample
+//   xsec <pb>            cross-section of the current sample
+//   include <name>       appends the files of another sample
+//   <path> [entries]     appends a file, optionally with its entry count
+//
+// Anything after a '#' is a comment. Files with a cached entry count are
+// added to a TChain without being opened; the others are opened by TChain
+// when it needs their size. CacheEntryCounts() fills in missing counts.
+
+#ifndef SAMPLE_REGISTRY_H
+#define SAMPLE_REGISTRY_H
+
+#include <TChain.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// A file of a sample, or (include = true) another sample pulled in by name.
+struct SampleEntry {
+  std::string path;
+  Long64_t entries = -1;  // -1 if not cached.
+  bool include = false;
+};
+
+
+struct Sample {
+  std::string name;
+  Double_t xsec = 0.;  // pb, 0 if unknown.
+  std::vector<SampleEntry> entries;
+};
+
+typedef std::map<std::string, Sample> SampleRegistry;
+
+
+// Drops comments and surrounding whitespace from a registry line.
+std::string StripRegistryLine(const std::string &line) {
+  std::string s = line.substr(0, line.find('#'));
+  size_t first = s.find_first_not_of(" \t\r");
+  if (first == std::string::npos) return "";
+  size_t last = s.find_last_not_of(" \t\r");
+  return s.substr(first, last - first + 1);
+}
+
+
+SampleRegistry LoadSampleRegistry(const char *registry_file) {
+  SampleRegistry registry;
+  std::ifstream in(registry_file);
+  if (!in) {
+    printf("Could not open sample registry %s \n", registry_file);
+    return registry;
+  }
+
+  Sample *current = 0;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    std::string s = StripRegistryLine(line);
+    if (s.empty()) continue;
+
+    std::istringstream tokens(s);
+    std::string first;
+    tokens >> first;
+
+    if (first == "sample") {
+      std::string name;
+      tokens >> name;
+      current = &registry[name];
+      current->name = name;
+      continue;
+    }
+    if (!current) {
+      printf("%s:%d: entry outside of a sample block \n", registry_file, line_number);
+      continue;
+    }
+
+    SampleEntry entry;
+    if (first == "xsec") {
+      tokens >> current->xsec;
+      continue;
+    } else if (first == "include") {
+      tokens >> entry.path;
+      entry.include = true;
+    } else {
+      entry.path = first;
+      if (!(tokens >> entry.entries)) entry.entries = -1;
+    }
+    current->entries.push_back(entry);
+  }
+
+  return registry;
+}
+
+
+// Flattens sample `name` and everything it includes into a list of files,
+// keeping the order in which they are listed.
+bool ResolveSampleFiles(const SampleRegistry &registry, const std::string &name,
+                        std::vector<SampleEntry> &files, int depth = 0) {
+  SampleRegistry::const_iterator it = registry.find(name);
+  if (it == registry.end()) {
+    printf("Unknown sample %s \n", name.c_str());
+    return false;
+  }
+  if (depth > 16) {
+    printf("Include loop while resolving sample %s \n", name.c_str());
+    return false;
+  }
+
+  for (const SampleEntry &entry : it->second.entries) {
+    if (entry.include) {
+      if (!ResolveSampleFiles(registry, entry.path, files, depth + 1)) return false;
+    } else {
+      files.push_back(entry);
+    }
+  }
+  return true;
+}
+
+
+// Adds the files of sample `name` to `chain`. Files with a cached entry
+// count are not opened here.
+bool AddSampleToChain(const SampleRegistry &registry, const std::string &name,
+                      TChain &chain) {
+  std::vector<SampleEntry> files;
+  if (!ResolveSampleFiles(registry, name, files)) return false;
+
+  for (const SampleEntry &file : files) {
+    chain.Add(file.path.c_str(), file.entries > 0 ? file.entries : TTree::kMaxEntries);
+  }
+  return true;
+}
+
+
+// Returns root_file_event_size / nentries for every tree of `chain`: the
+// per-file factor of the event reweight in the skim, computed once per file
+// rather than once per event.
+std::vector<Double_t> FileWeightFractions(TChain *chain, Long64_t total_entries) {
+  chain->GetEntries();  // Makes sure every tree offset is known.
+  const Long64_t *offsets = chain->GetTreeOffset();
+
+  Double_t nentries = total_entries;
+  std::vector<Double_t> fractions(chain->GetNtrees());
+  for (int i = 0; i < chain->GetNtrees(); ++i) {
+    Double_t root_file_event_size = offsets[i + 1] - offsets[i];
+    fractions[i] = root_file_event_size / nentries;
+  }
+  return fractions;
+}
+
+
+// Entries of `tree_name` in the file at `path`, or -1 if it cannot be
+// opened.
+Long64_t CountFileEntries(const std::string &path, const char *tree_name = "Delphes") {
+  TFile *f = TFile::Open(path.c_str());
+  if (!f || f->IsZombie()) {
+    printf("Could not open %s \n", path.c_str());
+    delete f;
+    return -1;
+  }
+  TTree *tree = (TTree*) f->Get(tree_name);
+  Long64_t entries = tree ? tree->GetEntries() : 0;
+  delete f;
+  return entries;
+}
+
+
+// Opens every file of the registry that has no cached entry count (or
+// every file, with refresh_all) and writes the counts back into the file.
+void CacheEntryCounts(const char *registry_file, const char *tree_name = "Delphes",
+                      bool refresh_all = false) {
+  std::vector<std::string> lines;
+  std::ifstream in(registry_file);
+  std::string line;
+  while (std::getline(in, line)) lines.push_back(line);
+  in.close();
+
+  int updated = 0;
+  for (std::string &l : lines) {
+    std::string s = StripRegistryLine(l);
+    if (s.empty()) continue;
+
+    std::istringstream tokens(s);
+    std::string path;
+    Long64_t entries = -1;
+    tokens >> path;
+    if (path == "sample" || path == "xsec" || path == "include") continue;
+    if ((tokens >> entries) && !refresh_all) continue;
+
+    entries = CountFileEntries(path, tree_name);
+    if (entries < 0) continue;
+
+    size_t comment = l.find('#');
+    std::string trailer = comment == std::string::npos ? "" : "  " + l.substr(comment);
+    l = path + " " + std::to_string(entries) + trailer;
+    updated++;
+  }
+
+  std::ofstream out(registry_file);
+  for (const std::string &l : lines) out << l << "\n";
+  printf("Cached entry counts for %d files in %s \n", updated, registry_file);
+}
+
+#endif
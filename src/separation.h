@@ -0,0 +1,237 @@
+// Separation metrics between signal and background shapes, computed for a
+// whole (variable x signal x background) cube at once.
+//
+// Each histogram is reduced to a BinnedShape: its bin edges and in-range
+// bin contents (under- and overflows left out, as in plotting/overlap.h),
+// normalised to unit sum. For every signal and background of a variable
+// with the same binning:
+//
+//   - overlap: sum over bins of sqrt(s * b), as overlap() in
+//     plotting/overlap.h on unit-area histograms; 1 for identical shapes,
+//     0 for disjoint ones;
+//   - KS distance: the largest difference between the two cumulative
+//     distributions, over bin edges;
+//   - the best one-sided cut: the bin edge and direction that maximise the
+//     gain in S/sqrt(B), eff_s / sqrt(eff_b), among cuts keeping at least
+//     `min_eff_b` of the background (so a few-event tail does not win).
+//
+// All three are ratios of shapes, so they do not depend on how the
+// histograms were normalised. Shapes are plain vectors: the histograms are
+// read on the calling thread and the cube is computed on a pool of threads
+// without touching ROOT.
+
+#ifndef SEPARATION_H
+#define SEPARATION_H
+
+#include <TH1.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cut_scan.h"
+
+
+struct BinnedShape {
+  std::string sample;
+  std::vector<Double_t> edges;    // nbins + 1.
+  std::vector<Double_t> content;  // Unit sum, or all zero for an empty histogram.
+  Double_t integral = 0;          // In-range sum before normalisation.
+};
+
+
+BinnedShape ShapeFromHistogram(const std::string &sample, const TH1 *h) {
+  BinnedShape shape;
+  shape.sample = sample;
+  int nbins = h->GetNbinsX();
+  for (int i = 1; i <= nbins + 1; ++i) shape.edges.push_back(h->GetXaxis()->GetBinLowEdge(i));
+  for (int i = 1; i <= nbins; ++i) {
+    shape.content.push_back(h->GetBinContent(i));
+    shape.integral += h->GetBinContent(i);
+  }
+  if (shape.integral != 0) {
+    for (Double_t &c : shape.content) c /= shape.integral;
+  }
+  return shape;
+}
+
+
+bool SameBinning(const BinnedShape &a, const BinnedShape &b) {
+  return a.edges == b.edges;
+}
+
+
+Double_t ShapeOverlap(const BinnedShape &s, const BinnedShape &b) {
+  Double_t overlap = 0;
+  for (size_t i = 0; i < s.content.size(); ++i) overlap += sqrt(s.content[i] * b.content[i]);
+  return overlap;
+}
+
+
+Double_t KSDistance(const BinnedShape &s, const BinnedShape &b) {
+  Double_t cdf_s = 0, cdf_b = 0, distance = 0;
+  for (size_t i = 0; i < s.content.size(); ++i) {
+    cdf_s += s.content[i];
+    cdf_b += b.content[i];
+    distance = std::max(distance, fabs(cdf_s - cdf_b));
+  }
+  return distance;
+}
+
+
+struct CutOptimum {
+  Double_t cut = 0;
+  CutDirection direction = kPassAbove;
+  Double_t eff_s = 1, eff_b = 1;
+  Double_t gain = 1;  // eff_s / sqrt(eff_b); 1 is no cut.
+};
+
+
+// Best cut at a bin edge of `s` and `b`, in either direction.
+CutOptimum OptimalCut(const BinnedShape &s, const BinnedShape &b, Double_t min_eff_b) {
+  CutOptimum best;
+  size_t nbins = s.content.size();
+  // Efficiencies of x < edge k; x > edge k keeps the rest.
+  Double_t below_s = 0, below_b = 0;
+  for (size_t k = 0; k <= nbins; ++k) {
+    if (k > 0) {
+      below_s += s.content[k - 1];
+      below_b += b.content[k - 1];
+    }
+    const Double_t eff[2][2] = {{1 - below_s, 1 - below_b}, {below_s, below_b}};
+    for (int d = 0; d < 2; ++d) {
+      Double_t eff_s = eff[d][0], eff_b = eff[d][1];
+      if (eff_b < min_eff_b || eff_b <= 0) continue;
+      Double_t gain = eff_s / sqrt(eff_b);
+      if (gain > best.gain) {
+        best.cut = s.edges[k];
+        best.direction = d == 0 ? kPassAbove : kPassBelow;
+        best.eff_s = eff_s;
+        best.eff_b = eff_b;
+        best.gain = gain;
+      }
+    }
+  }
+  return best;
+}
+
+
+// The shapes of one variable, e.g. one hist_<variable>.root file.
+struct SeparationVariable {
+  std::string name;
+  std::vector<BinnedShape> signals;
+  std::vector<BinnedShape> backgrounds;
+};
+
+
+struct SeparationResult {
+  std::string variable, signal, background;
+  Double_t overlap = 0;
+  Double_t ks = 0;
+  CutOptimum cut;
+};
+
+
+// Every (signal, background) pair of every variable, on `n_threads`
+// threads, in cube order. Pairs with different binnings or an empty shape
+// are reported and left out.
+std::vector<SeparationResult> ComputeSeparations(const std::vector<SeparationVariable> &variables,
+                                                 int n_threads = 1,
+                                                 Double_t min_eff_b = 0.01) {
+  struct Task {
+    const SeparationVariable *variable;
+    const BinnedShape *s, *b;
+  };
+  std::vector<Task> tasks;
+  for (const SeparationVariable &v : variables) {
+    for (const BinnedShape &s : v.signals) {
+      for (const BinnedShape &b : v.backgrounds) {
+        if (!SameBinning(s, b)) {
+          printf("%s: %s and %s have different binnings \n", v.name.c_str(), s.sample.c_str(),
+                 b.sample.c_str());
+          continue;
+        }
+        if (s.integral == 0 || b.integral == 0) {
+          printf("%s: %s or %s is empty \n", v.name.c_str(), s.sample.c_str(),
+                 b.sample.c_str());
+          continue;
+        }
+        tasks.push_back({&v, &s, &b});
+      }
+    }
+  }
+
+  std::vector<SeparationResult> results(tasks.size());
+  auto compute = [&](size_t t) {
+    const Task &task = tasks[t];
+    SeparationResult &r = results[t];
+    r.variable = task.variable->name;
+    r.signal = task.s->sample;
+    r.background = task.b->sample;
+    r.overlap = ShapeOverlap(*task.s, *task.b);
+    r.ks = KSDistance(*task.s, *task.b);
+    r.cut = OptimalCut(*task.s, *task.b, min_eff_b);
+  };
+
+  if (n_threads > (int) tasks.size()) n_threads = tasks.size();
+  if (n_threads <= 1) {
+    for (size_t t = 0; t < tasks.size(); ++t) compute(t);
+    return results;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int w = 0; w < n_threads; ++w) {
+    workers.emplace_back([&]() {
+      for (size_t t = next++; t < tasks.size(); t = next++) compute(t);
+    });
+  }
+  for (auto &worker : workers) worker.join();
+  return results;
+}
+
+
+// Most discriminating first: highest S/sqrt(B) gain, then lowest overlap.
+void SortSeparations(std::vector<SeparationResult> &results) {
+  std::stable_sort(results.begin(), results.end(),
+                   [](const SeparationResult &a, const SeparationResult &b) {
+    if (a.cut.gain != b.cut.gain) return a.cut.gain > b.cut.gain;
+    return a.overlap < b.overlap;
+  });
+}
+
+
+void PrintSeparations(const std::vector<SeparationResult> &results, size_t n_rows = 20) {
+  for (size_t i = 0; i < results.size() && i < n_rows; ++i) {
+    const SeparationResult &r = results[i];
+    printf("%3zu %-24s %-16s vs %-10s overlap %.3f  KS %.3f  x %s %g: gain %.2f (eff S %.2f, B %.3f) \n",
+           i + 1, r.variable.c_str(), r.signal.c_str(), r.background.c_str(), r.overlap, r.ks,
+           r.cut.direction == kPassAbove ? ">" : "<", r.cut.cut, r.cut.gain, r.cut.eff_s,
+           r.cut.eff_b);
+  }
+}
+
+
+// One tab-separated line per result, in the order given.
+bool WriteSeparationTable(const std::vector<SeparationResult> &results, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  fprintf(out, "rank\tvariable\tsignal\tbackground\toverlap\tks\tcut_direction\tcut\t"
+               "eff_s\teff_b\tgain\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const SeparationResult &r = results[i];
+    fprintf(out, "%zu\t%s\t%s\t%s\t%g\t%g\t%s\t%g\t%g\t%g\t%g\n", i + 1, r.variable.c_str(),
+            r.signal.c_str(), r.background.c_str(), r.overlap, r.ks,
+            r.cut.direction == kPassAbove ? ">" : "<", r.cut.cut, r.cut.eff_s, r.cut.eff_b,
+            r.cut.gain);
+  }
+  fclose(out);
+  return true;
+}
+
+#endif
@@ -0,0 +1,250 @@
+// Sharded batch execution: splitting a job into independent shards and
+// keeping a checkpoint per shard so a killed job can be resumed.
+//
+// Shard k of N gets the contiguous range of units (input files for the
+// skim, tree entries for the analyzer)
+//
+//   [n*k/N, n*(k+1)/N)
+//
+// so the shards taken in order cover the same units, in the same order, as
+// a single-process run. A shard works through its range in parts (one input
+// file, one chunk of entries), and after each part writes a checkpoint:
+// one "key value" per line with the range of the shard, the next unit to
+// run, and counters summed over the parts done so far. Every file is
+// written to a ".tmp" file and renamed into place, so a killed job leaves
+// either the previous version of a file or the new one, never a
+// half-written one. Running the same shard again resumes after the last
+// completed part; running a completed shard does nothing.
+//
+// Two renames are not one, though: a job can be killed after a part's
+// output is in place but before its checkpoint is. Where does the state
+// live then?
+//
+//  - The skim writes one output file per input file and then the
+//    checkpoint file <shard_dir>/<job>.shard<k>of<N>.checkpoint. Redoing
+//    a part whose checkpoint was lost overwrites the same output, so the
+//    checkpoint file is the state.
+//  - The analyzer adds every chunk to the same histogram file, so a chunk
+//    redone after a lost checkpoint would be counted twice. Its checkpoint
+//    is saved inside the histogram file (WriteShardCheckpoint()) and
+//    committed with it by one rename; that copy is the state, and the
+//    checkpoint file, written next, is only a copy for the merge and for
+//    people.
+//
+// The merge step (MergeCutflowShards() in Cutflow.C, MergeAnalyzerShards()
+// in Analyzer.C) refuses to run until every shard's checkpoint file says
+// done.
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <TDirectory.h>
+#include <TNamed.h>
+#include <TSystem.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Units [first, last) of one shard.
+struct ShardRange {
+  Long64_t first = 0;
+  Long64_t last = 0;
+};
+
+
+struct ShardCheckpoint {
+  ShardRange range;
+  Long64_t next = 0;  // First unit not done yet.
+  bool done = false;
+  std::map<std::string, Double_t> counters;
+};
+
+
+bool CheckShardArgs(int shard, int n_shards) {
+  if (n_shards < 1 || shard < 0 || shard >= n_shards) {
+    printf("Invalid shard %d of %d \n", shard, n_shards);
+    return false;
+  }
+  return true;
+}
+
+
+// Range of shard `shard` of `n_shards` over `n` units. With `align` > 1 the
+// boundaries fall on multiples of `align` (except the last one, at n), e.g.
+// so that shards fill histograms in the same blocks as a single pass.
+ShardRange GetShardRange(Long64_t n, int shard, int n_shards, Long64_t align = 1) {
+  Long64_t n_blocks = (n + align - 1) / align;
+  ShardRange range;
+  range.first = std::min(n, n_blocks * shard / n_shards * align);
+  range.last = std::min(n, n_blocks * (shard + 1) / n_shards * align);
+  return range;
+}
+
+
+// <shard_dir>/<job>.shard<k>of<N><suffix>
+std::string ShardPath(const char *shard_dir, const std::string &job, int shard,
+                      int n_shards, const char *suffix) {
+  char name[64];
+  snprintf(name, sizeof(name), ".shard%dof%d", shard, n_shards);
+  return std::string(shard_dir) + "/" + job + name + suffix;
+}
+
+
+// Moves a finished ".tmp" output into place.
+bool CommitShardFile(const std::string &tmp_path, const std::string &path) {
+  if (gSystem->Rename(tmp_path.c_str(), path.c_str()) != 0) {
+    printf("Could not rename %s to %s \n", tmp_path.c_str(), path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+// Reads a checkpoint in the format of FormatShardCheckpoint().
+void ParseShardCheckpoint(std::istream &in, ShardCheckpoint &checkpoint) {
+  checkpoint = ShardCheckpoint();
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream tokens(line);
+    std::string key;
+    if (!(tokens >> key)) continue;
+    if (key == "first") {
+      tokens >> checkpoint.range.first;
+    } else if (key == "last") {
+      tokens >> checkpoint.range.last;
+    } else if (key == "next") {
+      tokens >> checkpoint.next;
+    } else if (key == "done") {
+      tokens >> checkpoint.done;
+    } else {
+      tokens >> checkpoint.counters[key];
+    }
+  }
+}
+
+
+std::string FormatShardCheckpoint(const ShardCheckpoint &checkpoint) {
+  char line[256];
+  std::string text;
+  snprintf(line, sizeof(line), "first %lld\nlast %lld\nnext %lld\ndone %d\n",
+           checkpoint.range.first, checkpoint.range.last, checkpoint.next,
+           checkpoint.done ? 1 : 0);
+  text += line;
+  for (const auto &counter : checkpoint.counters) {
+    snprintf(line, sizeof(line), "%s %.17g\n", counter.first.c_str(), counter.second);
+    text += line;
+  }
+  return text;
+}
+
+
+// Returns false if there is no checkpoint at `path` yet.
+bool LoadShardCheckpoint(const char *path, ShardCheckpoint &checkpoint) {
+  std::ifstream in(path);
+  if (!in) return false;
+  ParseShardCheckpoint(in, checkpoint);
+  return true;
+}
+
+
+bool SaveShardCheckpoint(const char *path, const ShardCheckpoint &checkpoint) {
+  std::string tmp_path = std::string(path) + ".tmp";
+  FILE *out = fopen(tmp_path.c_str(), "w");
+  if (!out) {
+    printf("Cannot write %s \n", tmp_path.c_str());
+    return false;
+  }
+  fputs(FormatShardCheckpoint(checkpoint).c_str(), out);
+  if (fclose(out) != 0) {
+    printf("Cannot write %s \n", tmp_path.c_str());
+    return false;
+  }
+  return CommitShardFile(tmp_path, path);
+}
+
+
+const char *kShardCheckpointKey = "shard_checkpoint";
+
+
+// Saves `checkpoint` in `dir` of a shard output file, to be committed with
+// it.
+void WriteShardCheckpoint(TDirectory *dir, const ShardCheckpoint &checkpoint) {
+  TNamed text(kShardCheckpointKey, FormatShardCheckpoint(checkpoint).c_str());
+  dir->WriteTObject(&text, kShardCheckpointKey, "Overwrite");
+}
+
+
+// Returns false if `dir` holds no checkpoint.
+bool ReadShardCheckpoint(TDirectory *dir, ShardCheckpoint &checkpoint) {
+  TNamed *text = 0;
+  if (dir) dir->GetObject(kShardCheckpointKey, text);
+  if (!text) return false;
+  std::istringstream in(text->GetTitle());
+  ParseShardCheckpoint(in, checkpoint);
+  delete text;
+  return true;
+}
+
+
+// Continues from `checkpoint`, found at `path`, for a shard about to run,
+// or, if there was none (`found` false), starts a new one for `range`.
+// Returns false if the checkpoint was made for a different range (the
+// sample or the number of shards changed).
+bool ResumeShard(const char *path, bool found, const ShardRange &range,
+                 ShardCheckpoint &checkpoint) {
+  if (!found) {
+    checkpoint = ShardCheckpoint();
+    checkpoint.range = range;
+    checkpoint.next = range.first;
+    checkpoint.done = range.first == range.last;
+    return true;
+  }
+  if (checkpoint.range.first != range.first || checkpoint.range.last != range.last) {
+    printf("Checkpoint %s is for units [%lld, %lld), not [%lld, %lld); remove it to start over \n",
+           path, checkpoint.range.first, checkpoint.range.last, range.first, range.last);
+    return false;
+  }
+  if (checkpoint.done) {
+    printf("Shard already complete (%s) \n", path);
+  } else if (checkpoint.next > range.first) {
+    printf("Resuming at unit %lld of [%lld, %lld) \n", checkpoint.next, range.first, range.last);
+  }
+  return true;
+}
+
+
+// Loads the checkpoint file of a shard about to run, or starts a new one
+// for `range` (see ResumeShard()).
+bool StartShard(const char *path, const ShardRange &range, ShardCheckpoint &checkpoint) {
+  return ResumeShard(path, LoadShardCheckpoint(path, checkpoint), range, checkpoint);
+}
+
+
+// Loads the checkpoints of all `n_shards` shards of `job` for the merge.
+// Returns false if one is missing or not done.
+bool LoadFinishedShards(const char *shard_dir, const std::string &job, int n_shards,
+                        std::vector<ShardCheckpoint> &checkpoints) {
+  checkpoints.assign(n_shards, ShardCheckpoint());
+  for (int k = 0; k < n_shards; ++k) {
+    std::string path = ShardPath(shard_dir, job, k, n_shards, ".checkpoint");
+    if (!LoadShardCheckpoint(path.c_str(), checkpoints[k])) {
+      printf("Missing checkpoint %s \n", path.c_str());
+      return false;
+    }
+    if (!checkpoints[k].done) {
+      printf("Shard %d of %d of %s is not done (next unit %lld of [%lld, %lld)) \n", k, n_shards,
+             job.c_str(), checkpoints[k].next, checkpoints[k].range.first,
+             checkpoints[k].range.last);
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Selection thresholds of the Cutflow.C skim.
+//
+// Cutflow.C reads kSkimCuts, so another working point is a matter of
+// setting its fields before .x Cutflow.C. CutScan.C starts its threshold
+// grid from the same values.
+//
+// SkimSelectionKey() names the selection (code version and thresholds) for
+// the incremental skim cache (incremental_cache.h). Bump
+// kSkimSelectionVersion whenever SkimChain() changes what it selects or
+// writes, so cached skims made by the old code are not reused.
+
+#ifndef SKIM_CUTS_H
+#define SKIM_CUTS_H
+
+#include <Rtypes.h>
+
+#include <cstdio>
+#include <string>
+
+
+struct SkimCuts {
+  Double_t met_min = 30.;           // GeV
+  Double_t jet_eta_max = 2.4;
+  Double_t btag_pt_min = 20.;       // GeV
+  Double_t light_jet_pt_min = 30.;  // GeV
+  Double_t tau_pt_min = 30.;        // GeV
+  Double_t electron_pt_min = 26.;   // GeV
+  Double_t electron_eta_max = 2.1;
+  Double_t muon_pt_min = 23.;       // GeV
+  Double_t muon_eta_max = 2.4;
+};
+
+
+SkimCuts kSkimCuts;
+
+
+const int kSkimSelectionVersion = 1;
+
+
+std::string SkimSelectionKey(const SkimCuts &cuts) {
+  char key[256];
+  snprintf(key, sizeof(key), "v%d:%g:%g:%g:%g:%g:%g:%g:%g:%g", kSkimSelectionVersion,
+           cuts.met_min, cuts.jet_eta_max, cuts.btag_pt_min, cuts.light_jet_pt_min,
+           cuts.tau_pt_min, cuts.electron_pt_min, cuts.electron_eta_max, cuts.muon_pt_min,
+           cuts.muon_eta_max);
+  return key;
+}
+
+#endif
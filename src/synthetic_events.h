@@ -0,0 +1,156 @@
+// Reproducible synthetic events for benchmarks.
+//
+// The real samples live on /fdata and cannot be read off-cluster, so the
+// benchmark macros run on events drawn from simple distributions instead.
+// The same seed always gives the same events. Two kinds are made:
+//
+//   SyntheticEvent      Delphes-like reconstructed objects (jets with b and
+//                       tau tags, electrons, muons, MET, weight), about
+//                       what a ttbar + X sample looks like before the skim.
+//                       BenchmarkSkim.C writes them out as a Delphes tree.
+//   SyntheticSkimEvent  the six 4-vectors and weight of one flat skim tree
+//                       entry, as written by Cutflow.C and read by
+//                       Analyzer.C.
+//
+// Multiplicities are Poisson, pT spectra are exponentials above the skim
+// thresholds and eta is Gaussian, which is enough to exercise every branch
+// of the selections at realistic rates; the physics is not meant to be
+// right.
+
+#ifndef SYNTHETIC_EVENTS_H
+#define SYNTHETIC_EVENTS_H
+
+#include <TFile.h>
+#include <TMath.h>
+#include <TRandom3.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+
+const int kSyntheticMaxJets = 20;
+const int kSyntheticMaxLeptons = 6;
+
+
+// One reconstructed object.
+struct SyntheticObject {
+  Float_t pt, eta, phi, mass;
+  Int_t charge;
+  bool btag, tautag;
+};
+
+
+struct SyntheticEvent {
+  SyntheticObject jets[kSyntheticMaxJets];
+  SyntheticObject electrons[kSyntheticMaxLeptons];
+  SyntheticObject muons[kSyntheticMaxLeptons];
+  int n_jets, n_electrons, n_muons;
+  Float_t met, met_phi;
+  Float_t weight;
+};
+
+
+// pt, eta, phi, E of the six objects of a skim tree entry, as the
+// Float_t[4] branches of Cutflow.C.
+struct SyntheticSkimEvent {
+  Float_t tau[4], lep1[4], lep2[4], btag[4], jet[4], met[4];
+  Float_t weight;
+};
+
+
+class SyntheticEventGenerator {
+ public:
+  SyntheticEventGenerator(UInt_t seed = 1) : rng(seed) {}
+
+  void Next(SyntheticEvent &ev) {
+    ev.n_jets = std::min(rng.Poisson(5.5), kSyntheticMaxJets);
+    for (int j = 0; j < ev.n_jets; ++j) {
+      SyntheticObject &jet = ev.jets[j];
+      FillObject(jet, 20., 45., 1.6);
+      jet.mass = jet.pt * rng.Uniform(0.02, 0.15);
+      Double_t tag = rng.Rndm();
+      jet.tautag = tag < 0.08;
+      jet.btag = !jet.tautag && tag < 0.33;
+    }
+    ev.n_electrons = std::min(rng.Poisson(0.6), kSyntheticMaxLeptons);
+    for (int i = 0; i < ev.n_electrons; ++i) FillObject(ev.electrons[i], 10., 30., 1.2);
+    ev.n_muons = std::min(rng.Poisson(0.7), kSyntheticMaxLeptons);
+    for (int i = 0; i < ev.n_muons; ++i) FillObject(ev.muons[i], 10., 30., 1.2);
+    ev.met = rng.Exp(50.);
+    ev.met_phi = rng.Uniform(-TMath::Pi(), TMath::Pi());
+    ev.weight = rng.Uniform(0.5, 1.5);
+  }
+
+  void Next(SyntheticSkimEvent &ev) {
+    FillP4(ev.tau, 30., 40., 1.777);
+    FillP4(ev.lep1, 26., 30., 0.);
+    FillP4(ev.lep2, 23., 25., 0.);
+    FillP4(ev.btag, 20., 50., 4.8);
+    FillP4(ev.jet, 30., 40., 5.);
+    Double_t met = 30. + rng.Exp(40.);
+    ev.met[0] = met;
+    ev.met[1] = 0.;
+    ev.met[2] = rng.Uniform(-TMath::Pi(), TMath::Pi());
+    ev.met[3] = met;
+    ev.weight = rng.Uniform(0.5, 1.5);
+  }
+
+ private:
+  void FillObject(SyntheticObject &o, Double_t pt_min, Double_t pt_slope, Double_t eta_width) {
+    o.pt = pt_min + rng.Exp(pt_slope);
+    o.eta = rng.Gaus(0., eta_width);
+    o.phi = rng.Uniform(-TMath::Pi(), TMath::Pi());
+    o.mass = 0.;
+    o.charge = rng.Rndm() < 0.5 ? -1 : 1;
+    o.btag = o.tautag = false;
+  }
+
+  void FillP4(Float_t *arr, Double_t pt_min, Double_t pt_slope, Double_t mass) {
+    Double_t pt = pt_min + rng.Exp(pt_slope);
+    Double_t eta = rng.Gaus(0., 1.2);
+    Double_t p = pt * std::cosh(eta);
+    arr[0] = pt;
+    arr[1] = eta;
+    arr[2] = rng.Uniform(-TMath::Pi(), TMath::Pi());
+    arr[3] = std::sqrt(p*p + mass*mass);
+  }
+
+  TRandom3 rng;
+};
+
+
+// Writes `n_events` synthetic skim entries to the tree `tree_name` in
+// `path`, with the branches of Cutflow.C's BookSkimTree(). Returns false if
+// the file cannot be written.
+bool WriteSyntheticSkimTree(const char *path, const char *tree_name, Long64_t n_events,
+                            UInt_t seed = 1) {
+  TFile *file = TFile::Open(path, "RECREATE");
+  if (!file || file->IsZombie()) {
+    printf("Cannot write %s \n", path);
+    delete file;
+    return false;
+  }
+  SyntheticSkimEvent ev;
+  TTree *tree = new TTree(tree_name, "Synthetic skim");
+  tree->Branch("TauBranch", ev.tau, "tau_arr[4]/F");
+  tree->Branch("Lep1Branch", ev.lep1, "lep1_arr[4]/F");
+  tree->Branch("Lep2Branch", ev.lep2, "lep2_arr[4]/F");
+  tree->Branch("BTagBranch", ev.btag, "btag_arr[4]/F");
+  tree->Branch("JetBranch", ev.jet, "jet_arr[4]/F");
+  tree->Branch("METBranch", ev.met, "met_arr[4]/F");
+  tree->Branch("Weight", &ev.weight, "weight/F");
+
+  SyntheticEventGenerator generator(seed);
+  for (Long64_t i = 0; i < n_events; ++i) {
+    generator.Next(ev);
+    tree->Fill();
+  }
+  tree->Write();
+  file->Close();
+  delete file;
+  return true;
+}
+
+#endif
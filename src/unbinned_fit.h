@@ -0,0 +1,514 @@
+// Unbinned weighted maximum-likelihood fits of one-dimensional shapes.
+//
+// A binned fit (Fitter.C) depends on the binning it is given. Here the
+// events are plain (x, weight) arrays, e.g. the ditau mass of every event
+// of a skim tree, and the shape is fitted to them directly by minimising
+//
+//   NLL = c * (-sum_i w_i ln f(x_i) + W ln N),   N = integral of f on [lo, hi]
+//
+// where W is the sum of weights of the events in [lo, hi] and
+// c = W / sum_i w_i^2. With c the errors from the Hessian reflect the
+// effective number of events of a weighted sample, and c = 1 when
+// the events are unweighted.
+//
+// Shapes (parameters in order):
+//
+//   kCrystalBall  alpha, n, sigma, mean  as ROOT::Math::crystalball_function
+//                                        (alpha < 0: tail on the high side)
+//   kGaussian     sigma, mean
+//   kExponential  slope                  f = exp(slope * x)
+//
+// The log-density and its gradient are computed analytically per event,
+// with the shape's constants hoisted out of a loop over a block of
+// contiguous events. Each shape has its own loop, free of branches (the
+// crystal-ball core and tail are both computed and one is selected), and
+// the sums run in kSumLanes interleaved partial sums added in lane order,
+// so the compiler can vectorize the loop; the crystal-ball tail needs a
+// vector log, which depends on the compiler's math library. The NLL and
+// its gradient are summed block by block on `n_threads` threads, started
+// once per fit and kept waiting between evaluations, and the block sums
+// are added in block order, so a fit gives the same result for any number
+// of threads. The last point evaluated is cached: Minuit asks for the
+// value and the gradient at the same point separately, and both come from
+// one pass over the events. N and its gradient use the same per-point kernels
+// on a fixed composite Gauss-Legendre grid.
+// Minuit2 (Migrad) gets the function and its gradient in one call.
+
+#ifndef UNBINNED_FIT_H
+#define UNBINNED_FIT_H
+
+#include <Math/Factory.h>
+#include <Math/IFunction.h>
+#include <Math/Minimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum UnbinnedShape {kCrystalBall, kGaussian, kExponential};
+
+const int kMaxShapeParams = 4;
+const int kUnbinnedBlockSize = 4096;
+const int kSumLanes = 4;
+
+
+int ShapeParams(UnbinnedShape shape) {
+  return shape == kCrystalBall ? 4 : shape == kGaussian ? 2 : 1;
+}
+
+
+const char *ShapeName(UnbinnedShape shape) {
+  return shape == kCrystalBall ? "crystal_ball" : shape == kGaussian ? "gaussian" : "exponential";
+}
+
+
+std::vector<std::string> ShapeParamNames(UnbinnedShape shape) {
+  if (shape == kCrystalBall) return {"alpha", "N", "sigma", "mean"};
+  if (shape == kGaussian) return {"sigma", "mean"};
+  return {"slope"};
+}
+
+
+// Events in the fit range [lo, hi].
+struct UnbinnedData {
+  Double_t lo = 0, hi = 1;
+  std::vector<Double_t> x, w;
+
+  void Add(Double_t xi, Double_t wi) {
+    if (!(xi >= lo && xi <= hi)) return;
+    x.push_back(xi);
+    w.push_back(wi);
+  }
+  size_t size() const { return x.size(); }
+};
+
+
+namespace unbinned_detail {
+
+// The constants of a shape at one parameter point.
+struct ShapeKernel {
+  UnbinnedShape shape;
+  Double_t mean = 0, inv_sigma = 1, sign = 1;  // Gaussian and crystal-ball core.
+  Double_t a = 1, n = 1, b = 0, log_tail = 0;  // Crystal-ball tail.
+  Double_t log_n_over_a = 0;
+  Double_t slope = 0;
+
+  ShapeKernel(UnbinnedShape shape, const Double_t *par) : shape(shape) {
+    if (shape == kCrystalBall) {
+      sign = par[0] < 0 ? -1. : 1.;
+      a = fabs(par[0]);
+      n = par[1];
+      inv_sigma = 1 / par[2];
+      mean = par[3];
+      b = n / a - a;
+      log_n_over_a = log(n / a);
+      log_tail = n * log_n_over_a - 0.5 * a * a;
+    } else if (shape == kGaussian) {
+      inv_sigma = 1 / par[0];
+      mean = par[1];
+    } else {
+      slope = par[0];
+    }
+  }
+
+  // ln f(x) (unnormalised) and its derivatives with respect to the
+  // parameters, one function per shape.
+  inline Double_t ExponentialLogDensity(Double_t x, Double_t *grad) const {
+    grad[0] = x;
+    return slope * x;
+  }
+
+  // dt/dmean = -1/sigma, dt/dsigma = -t/sigma.
+  inline Double_t GaussianLogDensity(Double_t x, Double_t *grad) const {
+    Double_t t = (x - mean) * inv_sigma;
+    grad[0] = t * t * inv_sigma;
+    grad[1] = t * inv_sigma;
+    return -0.5 * t * t;
+  }
+
+  // Both the core and the tail are computed, and selected by t > -a.
+  // dt/dmean = -sign/sigma, dt/dsigma = -t/sigma.
+  inline Double_t CrystalBallLogDensity(Double_t x, Double_t *grad) const {
+    Double_t t = sign * (x - mean) * inv_sigma;
+    bool core = t > -a;
+    Double_t u = core ? 1. : b - t;
+    Double_t log_u = log(u);
+    Double_t log_f = core ? -0.5 * t * t : log_tail - n * log_u;
+    Double_t dlogf_dt = core ? -t : n / u;
+    Double_t dlogf_da = -n / a - a + n * (n / (a * a) + 1) / u;
+    grad[0] = core ? 0. : sign * dlogf_da;
+    grad[1] = core ? 0. : log_n_over_a + 1 - log_u - n / (a * u);
+    grad[2] = -dlogf_dt * t * inv_sigma;
+    grad[3] = -dlogf_dt * sign * inv_sigma;
+    return log_f;
+  }
+
+  inline Double_t LogDensity(Double_t x, Double_t *grad) const {
+    if (shape == kCrystalBall) return CrystalBallLogDensity(x, grad);
+    if (shape == kGaussian) return GaussianLogDensity(x, grad);
+    return ExponentialLogDensity(x, grad);
+  }
+};
+
+
+// sum w ln f and sum w d(ln f) over a block.
+struct BlockSums {
+  Double_t w_log_f = 0;
+  Double_t w_grad[kMaxShapeParams] = {0};
+};
+
+
+// Adds sum w ln f and sum w d(ln f) of n events to `sums`. Event i goes to
+// partial sum i % kSumLanes, and the partial sums are added in lane order.
+template <int kNPar, class LogDensity>
+void SumLanes(const LogDensity &log_density, const Double_t *x, const Double_t *w, int n,
+              BlockSums &sums) {
+  Double_t lane_log_f[kSumLanes] = {0};
+  Double_t lane_grad[kNPar][kSumLanes] = {{0}};
+  auto add = [&](int i, int l) {
+    Double_t grad[kNPar];
+    lane_log_f[l] += w[i] * log_density(x[i], grad);
+    for (int k = 0; k < kNPar; ++k) lane_grad[k][l] += w[i] * grad[k];
+  };
+  int n_full = n - n % kSumLanes;
+  for (int first = 0; first < n_full; first += kSumLanes) {
+    for (int l = 0; l < kSumLanes; ++l) add(first + l, l);
+  }
+  for (int i = n_full; i < n; ++i) add(i, i - n_full);
+  for (int l = 0; l < kSumLanes; ++l) {
+    sums.w_log_f += lane_log_f[l];
+    for (int k = 0; k < kNPar; ++k) sums.w_grad[k] += lane_grad[k][l];
+  }
+}
+
+
+void SumBlock(const ShapeKernel &kernel, const Double_t *x, const Double_t *w, int n,
+              BlockSums &sums) {
+  if (kernel.shape == kCrystalBall) {
+    SumLanes<4>([&kernel](Double_t xi, Double_t *grad) {
+      return kernel.CrystalBallLogDensity(xi, grad);
+    }, x, w, n, sums);
+  } else if (kernel.shape == kGaussian) {
+    SumLanes<2>([&kernel](Double_t xi, Double_t *grad) {
+      return kernel.GaussianLogDensity(xi, grad);
+    }, x, w, n, sums);
+  } else {
+    SumLanes<1>([&kernel](Double_t xi, Double_t *grad) {
+      return kernel.ExponentialLogDensity(xi, grad);
+    }, x, w, n, sums);
+  }
+}
+
+
+// Composite 8-point Gauss-Legendre rule on [lo, hi].
+const int kNormPanels = 256;
+const Double_t kGaussLegendreX[8] = {-0.9602898564975363, -0.7966664774136267,
+                                     -0.5255324099163290, -0.1834346424956498,
+                                     0.1834346424956498, 0.5255324099163290,
+                                     0.7966664774136267, 0.9602898564975363};
+const Double_t kGaussLegendreW[8] = {0.1012285362903763, 0.2223810344533745,
+                                     0.3137066458778873, 0.3626837833783620,
+                                     0.3626837833783620, 0.3137066458778873,
+                                     0.2223810344533745, 0.1012285362903763};
+
+
+// ln N and its gradient.
+Double_t LogNorm(const ShapeKernel &kernel, int n_par, Double_t lo, Double_t hi,
+                 Double_t *grad_log_norm) {
+  Double_t norm = 0, d_norm[kMaxShapeParams] = {0}, grad[kMaxShapeParams];
+  Double_t half = 0.5 * (hi - lo) / kNormPanels;
+  for (int p = 0; p < kNormPanels; ++p) {
+    Double_t center = lo + (2 * p + 1) * half;
+    for (int j = 0; j < 8; ++j) {
+      Double_t f = exp(kernel.LogDensity(center + half * kGaussLegendreX[j], grad));
+      Double_t q = half * kGaussLegendreW[j] * f;
+      norm += q;
+      for (int k = 0; k < n_par; ++k) d_norm[k] += q * grad[k];
+    }
+  }
+  for (int k = 0; k < n_par; ++k) grad_log_norm[k] = d_norm[k] / norm;
+  return log(norm);
+}
+
+
+// Threads that run a task over slices of [0, n), started on first use and
+// kept until destruction, so evaluating the NLL does not start threads.
+// The calling thread runs the first slice.
+class SliceWorkers {
+ public:
+  typedef std::function<void(size_t, size_t)> Task;
+
+  SliceWorkers(int n_threads) : n_threads(std::max(n_threads, 1)) {}
+
+  ~SliceWorkers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    start.notify_all();
+    for (std::thread &t : threads) t.join();
+  }
+
+  // Calls task(first, last) for each of the n_threads slices of [0, n),
+  // and returns when all of them are done.
+  void Run(size_t n, const Task &task) {
+    if (n_threads == 1) {
+      task(0, n);
+      return;
+    }
+    if (threads.empty()) {
+      for (int t = 1; t < n_threads; ++t) threads.emplace_back(&SliceWorkers::Loop, this, t);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      current = &task;
+      n_items = n;
+      pending = n_threads - 1;
+      generation++;
+    }
+    start.notify_all();
+    task(0, n / n_threads);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return pending == 0; });
+    current = 0;
+  }
+
+ private:
+  void Loop(int t) {
+    int seen = 0;
+    while (true) {
+      const Task *task;
+      size_t n;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        start.wait(lock, [&]() { return stop || generation != seen; });
+        if (stop) return;
+        seen = generation;
+        task = current;
+        n = n_items;
+      }
+      (*task)(n * t / n_threads, n * (t + 1) / n_threads);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--pending == 0) done.notify_one();
+    }
+  }
+
+  int n_threads;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable start, done;
+  const Task *current = 0;
+  size_t n_items = 0;
+  int generation = 0;
+  int pending = 0;
+  bool stop = false;
+};
+
+}  // namespace unbinned_detail
+
+
+// The NLL above as a Minuit2 function with an analytic gradient.
+class UnbinnedNLL : public ROOT::Math::IMultiGradFunction {
+ public:
+  UnbinnedNLL(const UnbinnedData &data, UnbinnedShape shape, int n_threads = 1)
+      : data(data), shape(shape), n_par(ShapeParams(shape)),
+        workers(std::make_shared<unbinned_detail::SliceWorkers>(n_threads)) {
+    Double_t sum_w2 = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+      sum_w += data.w[i];
+      sum_w2 += data.w[i] * data.w[i];
+    }
+    scale = sum_w2 > 0 ? sum_w / sum_w2 : 1.;
+  }
+
+  // Clones share the worker threads; Minuit evaluates one point at a time.
+  ROOT::Math::IMultiGradFunction *Clone() const { return new UnbinnedNLL(*this); }
+  unsigned int NDim() const { return n_par; }
+
+  void FdF(const double *par, double &f, double *df) const {
+    using namespace unbinned_detail;
+    if (cached && std::equal(par, par + n_par, cached_par)) {
+      f = cached_f;
+      std::copy(cached_grad, cached_grad + n_par, df);
+      return;
+    }
+    ShapeKernel kernel(shape, par);
+    size_t n_blocks = (data.size() + kUnbinnedBlockSize - 1) / kUnbinnedBlockSize;
+    std::vector<BlockSums> sums(n_blocks);
+    auto run = [&](size_t first_block, size_t last_block) {
+      for (size_t b = first_block; b < last_block; ++b) {
+        size_t first = b * kUnbinnedBlockSize;
+        int n = (int) std::min<size_t>(kUnbinnedBlockSize, data.size() - first);
+        SumBlock(kernel, &data.x[first], &data.w[first], n, sums[b]);
+      }
+    };
+    workers->Run(n_blocks, run);
+
+    Double_t grad_log_norm[kMaxShapeParams];
+    Double_t log_norm = LogNorm(kernel, n_par, data.lo, data.hi, grad_log_norm);
+    Double_t w_log_f = 0, w_grad[kMaxShapeParams] = {0};
+    for (const BlockSums &s : sums) {
+      w_log_f += s.w_log_f;
+      for (int k = 0; k < n_par; ++k) w_grad[k] += s.w_grad[k];
+    }
+    f = scale * (-w_log_f + sum_w * log_norm);
+    for (int k = 0; k < n_par; ++k) df[k] = scale * (-w_grad[k] + sum_w * grad_log_norm[k]);
+    n_calls++;
+
+    cached = true;
+    std::copy(par, par + n_par, cached_par);
+    cached_f = f;
+    std::copy(df, df + n_par, cached_grad);
+  }
+
+  void Gradient(const double *par, double *grad) const {
+    double f;
+    FdF(par, f, grad);
+  }
+
+  // Sum of weights in the fit range, and N at `par`.
+  Double_t SumWeights() const { return sum_w; }
+  Double_t Norm(const Double_t *par) const {
+    Double_t grad[kMaxShapeParams];
+    return exp(unbinned_detail::LogNorm(unbinned_detail::ShapeKernel(shape, par), n_par,
+                                        data.lo, data.hi, grad));
+  }
+  // Passes over the events; cached points are not counted.
+  int Calls() const { return n_calls; }
+
+ private:
+  double DoEval(const double *par) const {
+    double f, grad[kMaxShapeParams];
+    FdF(par, f, grad);
+    return f;
+  }
+
+  double DoDerivative(const double *par, unsigned int k) const {
+    double f, grad[kMaxShapeParams];
+    FdF(par, f, grad);
+    return grad[k];
+  }
+
+  const UnbinnedData &data;
+  UnbinnedShape shape;
+  int n_par;
+  std::shared_ptr<unbinned_detail::SliceWorkers> workers;
+  Double_t sum_w = 0;
+  Double_t scale = 1;
+  mutable int n_calls = 0;
+  mutable bool cached = false;
+  mutable Double_t cached_par[kMaxShapeParams];
+  mutable Double_t cached_f = 0;
+  mutable Double_t cached_grad[kMaxShapeParams];
+};
+
+
+struct UnbinnedFitResult {
+  std::string name;
+  UnbinnedShape shape = kCrystalBall;
+  int status = -1;               // Minimizer status; 0 is a good fit.
+  Double_t nll = 0;
+  int calls = 0;
+  Long64_t n_events = 0;
+  Double_t sum_weights = 0;
+  Double_t amplitude = 0;        // A of A * f(x) per unit x, as the Fitter.C TF1s per unit bin width.
+  std::vector<std::string> par_names;
+  std::vector<Double_t> par, err;
+};
+
+
+// Fits `shape` to `data` from `seed` (one value per parameter).
+// Parameters flagged in `fixed` stay at their seed. sigma is kept
+// positive and the crystal-ball N at least 0.1.
+UnbinnedFitResult FitUnbinned(const std::string &name, const UnbinnedData &data,
+                              UnbinnedShape shape, const std::vector<Double_t> &seed,
+                              const std::vector<bool> &fixed = std::vector<bool>(),
+                              int n_threads = 1) {
+  UnbinnedFitResult r;
+  r.name = name;
+  r.shape = shape;
+  r.par_names = ShapeParamNames(shape);
+  r.n_events = data.size();
+  int n_par = ShapeParams(shape);
+  if ((int) seed.size() != n_par || data.size() == 0) {
+    printf("%s: need %d seed values and some events in [%g, %g] \n", name.c_str(), n_par,
+           data.lo, data.hi);
+    return r;
+  }
+
+  UnbinnedNLL nll(data, shape, n_threads);
+  std::unique_ptr<ROOT::Math::Minimizer> minimizer(
+      ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad"));
+  minimizer->SetFunction(nll);
+  minimizer->SetPrintLevel(0);
+  minimizer->SetStrategy(1);
+  for (int k = 0; k < n_par; ++k) {
+    const std::string &par_name = r.par_names[k];
+    Double_t step = seed[k] != 0 ? 0.1 * fabs(seed[k]) : 0.1;
+    if (k < (int) fixed.size() && fixed[k]) {
+      minimizer->SetFixedVariable(k, par_name, seed[k]);
+    } else if (par_name == "sigma") {
+      minimizer->SetLowerLimitedVariable(k, par_name, seed[k], step, 1e-3);
+    } else if (par_name == "N") {
+      minimizer->SetLowerLimitedVariable(k, par_name, seed[k], step, 0.1);
+    } else {
+      minimizer->SetVariable(k, par_name, seed[k], step);
+    }
+  }
+  minimizer->Minimize();
+
+  r.status = minimizer->Status();
+  r.nll = minimizer->MinValue();
+  r.calls = nll.Calls();
+  r.sum_weights = nll.SumWeights();
+  r.par.assign(minimizer->X(), minimizer->X() + n_par);
+  r.err.assign(minimizer->Errors(), minimizer->Errors() + n_par);
+  r.amplitude = r.sum_weights / nll.Norm(r.par.data());
+  return r;
+}
+
+
+void PrintUnbinnedFits(const std::vector<UnbinnedFitResult> &results) {
+  for (const UnbinnedFitResult &r : results) {
+    printf("%s (%s, %lld events, sum of weights %g): A = %g", r.name.c_str(),
+           ShapeName(r.shape), r.n_events, r.sum_weights, r.amplitude);
+    for (size_t k = 0; k < r.par.size(); ++k) {
+      printf(", %s = %g +- %g", r.par_names[k].c_str(), r.par[k], r.err[k]);
+    }
+    printf("%s \n", r.status != 0 ? " --- FAILED" : "");
+  }
+}
+
+
+// One tab-separated line per fit: name, shape, status, NLL, calls, events,
+// sum of weights, A, then "name=value" and "name_err=error" per parameter
+// (the shapes have different parameters).
+bool WriteUnbinnedFitTable(const std::vector<UnbinnedFitResult> &results, const char *path) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    printf("Cannot write %s \n", path);
+    return false;
+  }
+  fprintf(out, "name\tshape\tstatus\tnll\tcalls\tevents\tsum_weights\tamplitude\tparameters\n");
+  for (const UnbinnedFitResult &r : results) {
+    fprintf(out, "%s\t%s\t%d\t%.10g\t%d\t%lld\t%g\t%g", r.name.c_str(), ShapeName(r.shape),
+            r.status, r.nll, r.calls, r.n_events, r.sum_weights, r.amplitude);
+    for (size_t k = 0; k < r.par.size(); ++k) {
+      fprintf(out, "\t%s=%g\t%s_err=%g", r.par_names[k].c_str(), r.par[k],
+              r.par_names[k].c_str(), r.err[k]);
+    }
+    fprintf(out, "\n");
+  }
+  fclose(out);
+  return true;
+}
+
+#endif
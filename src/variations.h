@@ -0,0 +1,190 @@
+// Systematic and reweighting variations, filled in the same pass as the
+// nominal histograms.
+//
+// A variation is a name and a few numeric parameters, read from a text file
+// with one variation per line:
+//
+//   # name       parameters
+//   xsec_up      scale=1.10
+//   lumi_down    scale=0.975
+//   topo_tight   topo_cdphi_min=0.3
+//
+// Anything after a '#' is a comment. What a parameter means is up to the
+// analyzer, which lists the keys it reads and turns every variation into a
+// weight column and a cut-bit column for each block of events
+// (VariationColumns).
+//
+// A VariationSet books one copy of every histogram of a HistogramSpec
+// table per variation, named <name>_<variation>, and fills all of them
+// from one block: the bin of an event is found once per histogram, and the
+// event is then added to each variation whose cut bits pass, with that
+// variation's weight. The event variables are computed and stored once, so
+// N variations cost one pass over the ntuple instead of N. Each copy comes
+// out exactly as a HistogramSet filled with that variation's weights and
+// cuts would.
+
+#ifndef VARIATIONS_H
+#define VARIATIONS_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "histogram_set.h"
+
+
+struct VariationConfig {
+  std::string name;
+  std::map<std::string, Double_t> params;
+
+  Double_t Get(const char *key, Double_t default_value) const {
+    std::map<std::string, Double_t>::const_iterator it = params.find(key);
+    return it == params.end() ? default_value : it->second;
+  }
+};
+
+
+// Reads a variations file (see above) whose parameters are among `keys`.
+// Lines that cannot be parsed or set another parameter are reported and
+// skipped.
+std::vector<VariationConfig> LoadVariations(const char *path,
+                                            const std::vector<std::string> &keys) {
+  std::vector<VariationConfig> variations;
+  std::ifstream in(path);
+  if (!in) {
+    printf("Could not open variations file %s \n", path);
+    return variations;
+  }
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    std::istringstream tokens(line.substr(0, line.find('#')));
+    VariationConfig variation;
+    if (!(tokens >> variation.name)) continue;
+
+    std::string param;
+    bool ok = true;
+    while (tokens >> param) {
+      size_t eq = param.find('=');
+      char *end = 0;
+      Double_t value = eq == std::string::npos ? 0. : strtod(param.c_str() + eq + 1, &end);
+      if (eq == std::string::npos || eq == 0 || !end || *end != '\0') {
+        printf("%s:%d: expected key=value, got %s \n", path, line_number, param.c_str());
+        ok = false;
+        break;
+      }
+      std::string key = param.substr(0, eq);
+      if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+        printf("%s:%d: unknown parameter %s \n", path, line_number, key.c_str());
+        ok = false;
+        break;
+      }
+      variation.params[key] = value;
+    }
+    if (ok) variations.push_back(variation);
+  }
+  return variations;
+}
+
+
+// Weights and cut bits of every variation for one block of events.
+class VariationColumns {
+ public:
+  VariationColumns(int n_variations)
+      : weight(n_variations * kColumnBlockSize, 0.),
+        cut_bits(n_variations * kColumnBlockSize, 0) {}
+
+  Double_t *Weights(int v) { return &weight[v * kColumnBlockSize]; }
+  UInt_t *Cuts(int v) { return &cut_bits[v * kColumnBlockSize]; }
+  const Double_t *Weights(int v) const { return &weight[v * kColumnBlockSize]; }
+  const UInt_t *Cuts(int v) const { return &cut_bits[v * kColumnBlockSize]; }
+
+ private:
+  std::vector<Double_t> weight;
+  std::vector<UInt_t> cut_bits;
+};
+
+
+template <class Block>
+class VariationSet {
+ public:
+  VariationSet(const std::vector<HistogramSpec<Block> > &specs,
+               const std::vector<std::string> &names)
+      : names(names) {
+    for (const HistogramSpec<Block> &spec : specs) {
+      Entry e;
+      e.spec = spec;
+      for (const std::string &name : names) {
+        e.acc.push_back(HistogramAccumulator(BookHistogram(spec, "_" + name)));
+      }
+      entries.push_back(e);
+    }
+  }
+
+  int Size() const { return names.size(); }
+  const std::string &Name(int v) const { return names[v]; }
+
+  // Accumulates events [0, n) of `block` into every variation. Call Flush()
+  // before reading the histograms.
+  void Fill(const Block &block, const VariationColumns &columns, int n) {
+    int n_variations = names.size();
+    for (Entry &e : entries) {
+      const HistogramSpec<Block> &s = e.spec;
+      const Double_t *x = block.*(s.x);
+      const Double_t *y = s.y ? block.*(s.y) : 0;
+      bool weighted = s.weighting == kEventWeight;
+
+      for (int i = 0; i < n; ++i) {
+        bool in_range;
+        int cell = SpecCell(s, x, y, i, in_range);
+        Double_t xi = x[i];
+        Double_t yi = y ? y[i] : 0.;
+        for (int v = 0; v < n_variations; ++v) {
+          if (s.cuts && (columns.Cuts(v)[i] & s.cuts) != s.cuts) continue;
+          e.acc[v].Add(cell, in_range, weighted ? columns.Weights(v)[i] : 1., xi, yi);
+        }
+      }
+    }
+  }
+
+  void Flush() {
+    for (Entry &e : entries) {
+      for (HistogramAccumulator &acc : e.acc) acc.Flush();
+    }
+  }
+
+  // Scales every histogram flagged `normalize` to unit area.
+  void Normalize() {
+    for (Entry &e : entries) {
+      if (!e.spec.normalize) continue;
+      for (HistogramAccumulator &acc : e.acc) acc.Scale(1/acc.hist->Integral());
+    }
+  }
+
+  // The histograms of variation `v` with an output key.
+  NamedHistograms Outputs(int v) const {
+    NamedHistograms out;
+    for (const Entry &e : entries) {
+      if (e.spec.key) out.push_back(NamedHistogram(e.spec.key, e.acc[v].hist));
+    }
+    return out;
+  }
+
+ private:
+  struct Entry {
+    HistogramSpec<Block> spec;
+    std::vector<HistogramAccumulator> acc;  // One per variation.
+  };
+
+  std::vector<std::string> names;
+  std::vector<Entry> entries;
+};
+
+#endif